@@ -1,32 +1,142 @@
-#import "lex/basilisk-lex.h" // lexer
-#import "parse/basilisk-parse.h" // parser
-#import "util/thread.h" // concurrency
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // vmsplice
+#endif
+#import "context.h" // lexer & parser
 #import "util/gerr.h" // general errors
+#import "index/index.h" // symbol index
+#import "parse/outline.h" // outlines
+#import "emit/emit.h" // emitter
 #import "basilisk.h" // Basilisk type
+#import <string.h> // strcmp
+#import <limits.h> // LONG_MAX
 
-// Basilisk main, launches both parser and lexer.
+// Basilisk main, parses a file or stdin.
+
+// size parses a number of bytes, with an optional K, M or G suffix
+long size(const char *str) {
+	char *end;
+	long n = strtol(str, &end, 10);
+	long unit = 1;
+	if (*end == 'K' || *end == 'k'){unit = 1L << 10; end++;}
+	else if (*end == 'M' || *end == 'm'){unit = 1L << 20; end++;}
+	else if (*end == 'G' || *end == 'g'){unit = 1L << 30; end++;}
+	if (end == str || *end != '\0' || n <= 0 || n > LONG_MAX / unit){gterr("bad size for --max-memory");}
+	return n * unit;
+}
+
+// flags sets options from arguments beginning with --,
+// returning the index of the first file argument.
+int flags(Basilisk *b, int argc, char *argv[]) {
+	int i;
+	for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++){
+		if (strcmp(argv[i], "--trivia") == 0){b->trivia = 1;}
+		else if (strcmp(argv[i], "--cons") == 0){b->cons = 1;}
+		else if (strncmp(argv[i], "--index=", 8) == 0){b->index = &argv[i][8];}
+		else if (strncmp(argv[i], "--lookup=", 9) == 0){b->lookup = &argv[i][9];}
+		else if (strncmp(argv[i], "--trace=", 8) == 0){b->trace = &argv[i][8];}
+		else if (strncmp(argv[i], "--max-memory=", 13) == 0){b->gov.max = size(&argv[i][13]);}
+		else if (strncmp(argv[i], "--max-time=", 11) == 0){b->gov.maxtime = atof(&argv[i][11]);}
+		else if (strncmp(argv[i], "--deadline=", 11) == 0){b->timeout = atof(&argv[i][11]);}
+		else if (strcmp(argv[i], "--mem") == 0){b->mem = 1;}
+		else if (strcmp(argv[i], "--outline") == 0){b->outline = 1;}
+		else if (strcmp(argv[i], "--highlight") == 0){b->highlight = 1;}
+		else if (strcmp(argv[i], "--check") == 0){b->check = 1;}
+		else if (strcmp(argv[i], "--emit=source") == 0){b->emit = emitSource;}
+		else if (strcmp(argv[i], "--emit=pretty") == 0){b->emit = emitPretty;}
+		else if (strcmp(argv[i], "--emit=tokens") == 0){b->wired = wireTokens;}
+		else if (strcmp(argv[i], "--emit=ast") == 0){b->wired = wireAst;}
+		else if (strncmp(argv[i], "--form=", 7) == 0){b->outline = 1; b->form = atoi(&argv[i][7]);}
+		else{
+			char str[100];
+			snprintf(str, sizeof str, "unknown flag: %s", argv[i]);
+			gterr(str);
+		}
+	}
+	if (b->highlight && (b->emit || b->wired)){gterr("--highlight & --emit both write to stdout");}
+	return i;
+}
+
+// writes the trace, if one was asked for
+int dumptrace(Basilisk *b) {
+	if (b->trace == NULL){return 0;}
+	FILE *f = fopen(b->trace, "w");
+	if (f == NULL){gperr(); return 1;}
+	int err = tracedump(f);
+	return fclose(f) || err;
+}
+
+// prints the outline of b's stream, or parses one form of it
+int outline(Basilisk *b) {
+	OutlineSrc r;
+	if (readoutline(&r, b->stream)){gerr("could not read input"); return 1;}
+	if (r.len > UINT32_MAX){gerr("input too long to outline"); return 1;}
+	Outline *o = initoutline(b, r.src, r.len);
+	if (o == NULL){gperr(); return 1;}
+	int err = 0;
+	if (b->form < 0){printoutline(o, b->name, stdout);}
+	else if (b->form < o->nform){
+		outlinetree(o, b->form);
+		noteparse(b);
+	} else{gerr("no such form"); err = 1;}
+	if (o->unclosed){gnote("last form is unclosed");}
+	if (o->stray > 0){
+		char str[50];
+		snprintf(str, sizeof str, "%d unmatched )", o->stray);
+		gnote(str);
+	}
+	freeoutline(o);
+	freeoutlinesrc(&r);
+	return err;
+}
+
+// writes the tree of the last parse to stdout
+int emittree(Basilisk *b) {
+	Emitter *e = initemit(STDOUT_FILENO, b->emit == emitPretty ? EmitWidth : 0);
+	if (e == NULL){gperr(); return 1;}
+	int err = emit(e, b->root, b->text, b->textlen);
+	if (err){gperr();}
+	freeemit(e);
+	return err;
+}
 
 int main(int argc, char *argv[]) {
-	Basilisk b;
-	if (argc > 1){
-		b.name = argv[1];
-		b.stream = fopen(argv[1], "r");
+	Basilisk b = {.trivia = 0, .cons = 0, .index = NULL, .lookup = NULL, .trace = NULL, .gov = {}, .mem = 0, .outline = 0, .form = -1, .highlight = 0, .check = 0, .emit = 0, .timeout = 0};
+	int i = flags(&b, argc, argv);
+	if (b.trace != NULL){tracestart();}
+	tracename("main");
+
+	// index the files given, or look up the symbols given
+	if (b.index != NULL){
+		int err = buildindex(b.index, &argv[i], argc - i);
+		return dumptrace(&b) || err;
+	}
+	if (b.lookup != NULL){return lookupsyms(b.lookup, &argv[i], argc - i);}
+
+	if (i < argc){
+		b.name = argv[i];
+		b.stream = fopen(argv[i], "r");
 		if (b.stream == NULL){return 1;}
 	} else {
 		gnote("reading from stdin");
 		b.name = "stdin";
 		b.stream = stdin;
 	}
-	b.tok = initmstack();
-	Stack *stack = initstack();
+	b.errstream = stderr;
+	govern(&b.gov, memTok);
+	if (govstart(&b.gov)){gperr(); return 1;}
+	if (initcontext(&b)){gperr(); return 1;}
 
-	// spawn lexer & parser
-	pspawn(stack, lex, (void *) &b); 
-	pspawn(stack, parse, (void *) &b);
-
-	// wait for lexer & parser
-	for (int i = 0; i < 2; i++){pwait(stack);}
-
-	freemstack(b.tok);
-	freestack(stack);
+	int err = 0;
+	if (b.outline){err = outline(&b);}
+	else {
+		if (runcontext(&b)){gperr(); return 1;}
+		if (b.emit){err = emittree(&b);}
+		else if (b.wire != NULL){err = wireend(b.wire, b.cancelled);} // reported as it failed
+		noteparse(&b);
+		err |= b.cancelled;
+	}
+	freecontext(&b);
+	govdone(&b.gov);
+	if (b.mem || b.gov.max > 0){govnote(&b.gov);}
+	return dumptrace(&b) || err;
 }
\ No newline at end of file
@@ -1,4 +1,13 @@
 #import "util/concurrent.h" // MutexStack
+#import "util/broadcast.h" // Broadcast
+#import "util/stack.h" // Stack
+#import "util/govern.h" // Governor
+#import "tok/tok.h" // TokPool
+#import "lex/input.h" // Input
+#import "parse/ast.h" // AsTree
+#import "parse/cons.h" // ConsTable
+#import "parse/check.h" // Checker
+#import "wire/write.h" // Wire
 
 // Header file for things that are useful for 
 // communicating between the basiliks.
@@ -7,12 +16,58 @@
 #ifndef BASILISK
 #define BASILISK
 
+// subscribers to a token broadcast
+const int subParse = 0;
+const int subHighlight = 1;
+const int subWire = 1; // in place of the highlighter, both write to stdout
+
 // Basilisk struct, for random info storing
 typedef struct {
 	char *name;
 	FILE *stream;
+	char *buf; // buffer to lex instead of stream, or NULL
+	long buflen;
+	long bufoff; // offset in buf to begin lexing at
+	FILE *errstream; // stream to error, or NULL to only count
 	MutexStack *tok; // token stack
+	Broadcast *cast; // tokens for the parser & highlighter, or NULL for tok
+	Stack *src; // source buffers sliced by tokens
 	int cond; // condition to wait on
+	int trivia; // keep whitespace & comments as token trivia
+	int cons; // share identical subtrees
+	char *index; // index to update, or NULL
+	char *lookup; // index to look symbols up in, or NULL
+	char *trace; // file to write a trace to, or NULL
+	Governor gov; // memory & time budgets
+	int mem; // note peak memory
+	int outline; // print the outline rather than parse
+	int form; // form of the outline to parse, or -1
+	int highlight; // print the source highlighted as it is parsed
+	int check; // check forms as they are parsed
+	int emit; // write the tree back out as source, one of emitSource & emitPretty, or 0
+	int wired; // write the tokens or tree to stdout as they are made, wireTokens or wireAst, or 0
+	Wire *wire; // where they are written, or NULL
+	Checker *checker; // checks of each form, or NULL
+	double timeout; // seconds before a run is cancelled, 0 for none
+	Cancel *cancel; // cancels the run from any thread, or by a deadline
+
+	// results of the last parse
+	AsTree *root; // parsed tree
+	ConsTable *table; // shared subtrees of root, or NULL
+	char *text; // source sliced by root
+	long textlen;
+	int errors;
+	int warns;
+	int dropped; // lexical errors past LexErrMax, counted but not reported
+	int cancelled; // root is only what was parsed before a cancel
+
+	// kept from parse to parse, or NULL to allocate each time
+	char *str; // lexer buffer
+	long strlen;
+	Input *in; // input blocks
+	TokPool *spare; // token buffers
+	AstPool *pool; // trees & nodes
+	Stack *up; // parser's ancestors
 } Basilisk;
 
-#endif // BASILISK
\ No newline at end of file
+#endif // BASILISK
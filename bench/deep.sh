@@ -0,0 +1,25 @@
+#!/bin/bash
+# Benchmark of deeply nested input.
+# Parses lists nested depth deep, and twice as deep, with & without
+# hash consing; times should double with depth, not grow faster.
+#
+#	bench/deep.sh [basilisk] [depth]
+
+bin=${1:-./basilisk}
+depth=${2:-1000000}
+tmp=${TMPDIR:-/tmp}/basilisk-deep.$$
+trap 'rm -f "$tmp"' EXIT
+TIMEFORMAT=%R
+
+for d in "$depth" $((depth * 2)); do
+	awk -v d="$d" 'BEGIN {
+		for (i = 0; i < d; i++) printf "(a%d 1 ", i % 7
+		printf "\"s\""
+		for (i = 0; i < d; i++) printf ")"
+		printf "\n"
+	}' > "$tmp"
+	for flags in "" --cons; do
+		t=$( { time "$bin" $flags "$tmp" 2>/dev/null; } 2>&1 )
+		printf '%d deep %-7s %ss\n' "$d" "$flags" "$t"
+	done
+done
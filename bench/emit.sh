@@ -0,0 +1,32 @@
+#!/bin/bash
+# Benchmark of emitting.
+# Parses a file of top-level forms with & without writing them back out;
+# the input is laid out as --emit=source writes it, so it must come
+# back byte for byte. The wire streams are decoded by bench/wire.c,
+# through a pipe & from a file, and must give it back too.
+#
+#	bench/emit.sh [basilisk] [forms]
+
+bin=${1:-./basilisk}
+forms=${2:-200000}
+tmp=${TMPDIR:-/tmp}/basilisk-emit.$$
+trap 'rm -f "$tmp" "$tmp.out" "$tmp.wire"' EXIT
+TIMEFORMAT=%R
+
+awk -v n="$forms" 'BEGIN {
+	for (i = 0; i < n; i++) printf "(add%d 1 2 \"s\" (x 3 4))\n", i % 100
+}' > "$tmp"
+mb=$(( $(wc -c < "$tmp") / 1000000 ))
+
+for flags in "" --emit=source --emit=pretty --emit=tokens --emit=ast; do
+	t=$( { time "$bin" $flags "$tmp" > "$tmp.out" 2>/dev/null; } 2>&1 )
+	printf '%dMB %-14s %ss\n' "$mb" "$flags" "$t"
+done
+"$bin" --emit=source "$tmp" 2>/dev/null | cmp -s - "$tmp" || echo "--emit=source changed the input"
+
+${CC:-cc} -w -o "$tmp.wire" "$(dirname "$0")/wire.c" || exit 1
+for flags in "--emit=tokens --trivia" --emit=ast; do
+	"$bin" $flags "$tmp" 2>/dev/null | "$tmp.wire" | cmp -s - "$tmp" || echo "$flags changed the input, through a pipe"
+	"$bin" $flags "$tmp" > "$tmp.out" 2>/dev/null
+	"$tmp.wire" < "$tmp.out" | cmp -s - "$tmp" || echo "$flags changed the input, from a file"
+done
@@ -0,0 +1,18 @@
+#!/bin/bash
+# Check of the generated operator table.
+# tok/ops.h is generated from tok/ops & checked in, as there is no
+# build step to make it; this regenerates it and fails if the checked
+# in table is stale.
+#
+#	bench/ops.sh
+
+dir=$(dirname "$0")/..
+tmp=${TMPDIR:-/tmp}/basilisk-ops.$$
+trap 'rm -f "$tmp" "$tmp.h"' EXIT
+
+${CC:-cc} -w -o "$tmp" "$dir/tok/genops.c" || exit 1
+"$tmp" < "$dir/tok/ops" > "$tmp.h" || exit 1
+if ! cmp -s "$tmp.h" "$dir/tok/ops.h"; then
+	echo "tok/ops.h is stale, regenerate it from tok/ops"
+	exit 1
+fi
@@ -0,0 +1,83 @@
+#import <stdio.h> // fwrite
+#import <stdlib.h> // realloc
+#import "../wire/read.h" // wire reader
+
+// Decodes a stream of --emit=tokens or --emit=ast from stdin back to
+// text on stdout, so bench/emit.sh can cmp it with what was parsed:
+//
+//	cc bench/wire.c -o wire && ./basilisk --emit=ast f.lsp | ./wire
+//
+// Tokens are written with the trivia before them, so with --trivia
+// a token stream gives back the source byte for byte. Trees are
+// written a top-level form a line, as --emit=source writes them.
+// Exits 1 if the stream is not one, is cut short, or slices text it
+// never carried, so the reader is built & run with the benchmarks.
+
+typedef struct {
+	long left; // subtrees not yet written
+	int sep; // does the next subtree need a space before it?
+} List;
+
+List *lists; // lists being written, innermost last
+int nlists, maxlists;
+
+// writes the n bytes at off of the source, nonzero if it has none there
+int text (WireReader *r, uint32_t off, uint32_t n) {
+	if (off > (uint64_t) r->srclen || n > (uint64_t) r->srclen - off){return 1;}
+	fwrite(wtext(r, off), 1, n, stdout);
+	return 0;
+}
+
+int tokens (WireReader *r, WireRec *rec) {
+	int n;
+	const WireTok *t = wtoks(rec, &n);
+	for (int i = 0; i < n; i++){
+		if (t[i].triv > t[i].off || text(r, t[i].off - t[i].triv, t[i].triv + wirelen(t[i].kind))){return 1;}
+	}
+	return 0;
+}
+
+int nodes (WireReader *r, WireRec *rec) {
+	int n;
+	const WireNode *v = wnodes(rec, &n);
+	for (int i = 0; i < n; i++){
+		if (nlists > 0 && lists[nlists - 1].sep){putchar(' ');}
+		if (nlists > 0){lists[nlists - 1].sep = 1;}
+		int type = wiretype(v[i].kind);
+		int list = type == wireOp || type == wireBeginList;
+		if (list){putchar('(');}
+		if (type != wireBeginList && text(r, v[i].off, wirelen(v[i].kind))){return 1;}
+		if (list && v[i].nsub > 0){
+			if (nlists == maxlists){
+				maxlists = maxlists > 0 ? maxlists * 2 : 64;
+				lists = realloc(lists, maxlists * sizeof (List));
+				if (lists == NULL){return 1;}
+			}
+			List o = {.left = v[i].nsub, .sep = type != wireBeginList};
+			lists[nlists++] = o;
+			continue;
+		}
+		if (list){putchar(')');}
+		// close the lists this was the last subtree of
+		while (nlists > 0 && --lists[nlists - 1].left == 0){putchar(')'); nlists--;}
+		if (nlists == 0){putchar('\n');}
+	}
+	return 0;
+}
+
+int main () {
+	WireReader *r = initwreader(0);
+	if (r == NULL){fprintf(stderr, "wire: not a stream\n"); return 1;}
+	WireRec *rec;
+	int err = 0;
+	while (!err && (rec = wnext(r)) != NULL){
+		if (r->what == (uint32_t) wireTokens){err = tokens(r, rec);}
+		else{err = nodes(r, rec);}
+	}
+	if (err){fprintf(stderr, "wire: could not decode the stream\n");}
+	else if (!r->end){fprintf(stderr, "wire: stream cut short\n"); err = 1;}
+	else if (nlists > 0){fprintf(stderr, "wire: form cut short\n"); err = 1;}
+	freewreader(r);
+	free(lists);
+	return err;
+}
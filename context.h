@@ -0,0 +1,126 @@
+#import <pthread.h>
+#import "lex/basilisk-lex.h" // lexer
+#import "parse/basilisk-parse.h" // parser
+#import "highlight/highlight.h" // highlighter
+#import "basilisk.h" // Basilisk type
+
+// Contexts
+// a context is a Basilisk set up to parse again and again: its token
+// stack, pools, lexer buffer & input blocks outlive each parse, so
+// once they have grown to fit, parsing does not allocate.
+// The lexer runs on its own thread, the parser on the caller's.
+// When highlighting, the lexer broadcasts its tokens to the parser
+// & the highlighter, which runs on a thread of its own.
+// When checking, the checker runs on a third thread, taking each
+// top-level form from the parser as it ends.
+// Streaming tokens, the wire writer takes the highlighter's place;
+// streaming the tree, the parser writes each top-level form.
+// A run is cancelled through b->cancel, each thread returning
+// as soon as it sees it, with the tree parsed up to then.
+
+// Include guard.
+#ifndef CONTEXT
+#define CONTEXT
+
+// hands a token buffer every subscriber has read back to the pool
+void _castdrop (void *pool, void *buf) {givetokbuf(pool, buf);}
+
+int initcontext (Basilisk *b) {
+	b->tok = initmstack();
+	b->src = initstack();
+	b->spare = inittokpool();
+	b->pool = initastpool();
+	b->up = initstack();
+	b->cancel = initcancel();
+	if (b->tok == NULL || b->src == NULL || b->spare == NULL || b->pool == NULL || b->up == NULL || b->cancel == NULL){return 1;}
+	b->tok->cap = 64; // token chunks in flight, bounding the token stage
+	b->tok->cancel = b->cancel;
+	b->up->keep = 1;
+	b->cancel->timeout = b->timeout;
+	if (cancelwatch(b->cancel, b->tok->lock, b->tok->cond)){return 1;}
+	if (b->check){
+		b->checker = initcheck(&b->gov);
+		if (b->checker == NULL){return 1;}
+		b->checker->forms->cancel = b->cancel;
+		if (cancelwatch(b->cancel, b->checker->forms->lock, b->checker->forms->cond)){return 1;}
+	}
+	if (b->wired){
+		b->wire = initwire(STDOUT_FILENO, b->wired);
+		if (b->wire == NULL){return 1;}
+	}
+	if (b->highlight || b->wired == wireTokens){
+		b->cast = initbroadcast(64, 2, _castdrop, b->spare);
+		if (b->cast == NULL){return 1;}
+		b->cast->cancel = b->cancel;
+		if (cancelwatch(b->cancel, &b->cast->lock, &b->cast->cond)){return 1;}
+		if (b->wire != NULL){b->wire->cast = b->cast; b->wire->sub = subWire;}
+	}
+	return 0;
+}
+
+// parses b->buf, or b->stream when it is NULL. If a thread cannot
+// start, or the lexer cannot, the run is cancelled so those started
+// end, and is an error.
+int runcontext (Basilisk *b) {
+	pthread_t th, hl, ck;
+	int casting = 0, checking = 0, lexing = 0; // threads started
+	int err = 0;
+	if (b->highlight){err = pthread_create(&hl, NULL, highlight, b); casting = !err;}
+	else if (b->wired == wireTokens){err = pthread_create(&hl, NULL, wiretokens, b->wire); casting = !err;}
+	if (!err && b->checker != NULL){err = pthread_create(&ck, NULL, checkforms, b->checker); checking = !err;}
+	if (!err){err = pthread_create(&th, NULL, lex, b); lexing = !err;}
+	Governor *gov = governor;
+	int stage = memStage;
+	if (err || cancelstart(b->cancel)){cancel(b->cancel);} // lex & parse end at once
+	if (lexing){parse(b);}
+	govern(gov, stage);
+	void *failed = NULL;
+	if (lexing){err |= pthread_join(th, &failed) || failed != NULL;}
+	b->errors += b->dropped;
+	if (casting){err |= pthread_join(hl, NULL);}
+	if (checking){
+		err |= pthread_join(ck, NULL);
+		b->errors += b->checker->errors;
+		b->warns += b->checker->warns;
+	}
+	cancelstop(b->cancel);
+	b->cancelled = cancelled(b->cancel);
+	return err;
+}
+
+// drops the last parse, keeping what it allocated for the next
+void resetcontext (Basilisk *b) {
+	freeparse(b);
+	// keep the lexer's last str, free those it outgrew
+	char *src = pop(b->src);
+	if (src != NULL){gfree(b->str); b->str = src;}
+	while ((src = pop(b->src)) != NULL){gfree(src);}
+	TokBuf *buf;
+	while ((buf = mleft(b->tok)) != NULL){givetokbuf(b->spare, buf);} // lexed before a cancel
+	resetmstack(b->tok);
+	if (b->cast != NULL){resetbroadcast(b->cast);}
+	if (b->checker != NULL){resetcheck(b->checker);}
+	resetcancel(b->cancel);
+	b->cancelled = 0;
+	b->text = NULL;
+}
+
+int freecontext (Basilisk *b) {
+	AstPool *pool = b->pool;
+	b->pool = NULL; // free the tree rather than pool it
+	resetcontext(b);
+	if (b->in != NULL){freeinput(b->in);}
+	gfree(b->str);
+	freeastpool(pool);
+	freetokpool(b->spare);
+	freestack(b->up);
+	freestack(b->src);
+	freemstack(b->tok);
+	if (b->cast != NULL){freebroadcast(b->cast);}
+	if (b->checker != NULL){freecheck(b->checker);}
+	if (b->wire != NULL){freewire(b->wire);}
+	freecancel(b->cancel);
+	return 0;
+}
+
+#endif // CONTEXT
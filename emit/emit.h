@@ -0,0 +1,244 @@
+#import <sys/uio.h> // writev
+#import <unistd.h> // ssize_t
+#import <errno.h> // EINTR
+#import <string.h> // memset
+#import "../tok/tok.h" // itemOp
+#import "../parse/ast.h" // AsTree
+#import "../util/govern.h" // gmalloc
+
+// Emitter
+// emit writes a tree back out as source. Operators & atoms are never
+// copied: each is a slice of the source, gathered with the parens,
+// spaces & newlines between them into one writev. Those are written
+// to a buffer, unless the source has the same byte just past the last
+// slice, when the slice grows over it instead; so source already laid
+// out as it is emitted goes out as a few long slices.
+// emitSource writes each top-level form on a line, emitPretty also
+// breaks lists too wide for a line, one element per line.
+
+// Include guard.
+#ifndef EMIT
+#define EMIT
+
+const int emitSource = 1;
+const int emitPretty = 2;
+
+const int EmitBufLen = 1 << 20;
+const int EmitIovLen = 1024; // IOV_MAX of Linux & the BSDs
+const int EmitWidth = 80;
+
+// a tree being measured or emitted
+typedef struct {
+	AsTree *tree;
+	int sub; // next subtree to emit
+	int broken; // is each element on a line of its own?
+	long width; // width on one line, so far
+	long i; // index in flat
+	long indent; // column it begins at
+} EmitFrame;
+
+// a tree laid out on one line
+typedef struct {
+	long width;
+	long end; // index in flat past its subtrees
+} EmitFlat;
+
+typedef struct {
+	int fd;
+	int width; // line width, 0 to never break lines
+	char *src; // source sliced by the tree
+	long srclen;
+	struct iovec *iov;
+	int niov;
+	char *buf; // parens, spaces & newlines sliced by iov
+	int len;
+	long col; // column of the next byte
+	char last; // last byte emitted
+	EmitFlat *flat; // each tree, in walk order
+	long nflat, maxflat;
+	EmitFrame *frame; // by depth
+	int maxframe;
+	long out; // bytes written
+	int err;
+} Emitter;
+
+Emitter *initemit (int fd, int width) {
+	Emitter *e = gcalloc(1, sizeof (Emitter));
+	if (e == NULL){return NULL;}
+	e->iov = gmalloc(EmitIovLen * sizeof (struct iovec));
+	e->buf = gmalloc(EmitBufLen);
+	if (e->iov == NULL || e->buf == NULL){return NULL;}
+	e->fd = fd;
+	e->width = width;
+	return e;
+}
+
+int freeemit (Emitter *e) {
+	gfree(e->iov); gfree(e->buf);
+	gfree(e->flat); gfree(e->frame);
+	gfree(e);
+	return 0;
+}
+
+// writes everything gathered, the buffer is free again after
+int _emitflush (Emitter *e) {
+	struct iovec *v = e->iov;
+	int n = e->niov;
+	while (n > 0 && !e->err){
+		ssize_t w = writev(e->fd, v, n);
+		if (w < 0){
+			if (errno != EINTR){e->err = 1;}
+			continue;
+		}
+		e->out += w;
+		for (; n > 0 && (size_t) w >= v->iov_len; v++, n--){w -= v->iov_len;}
+		if (n > 0){v->iov_base = (char *) v->iov_base + w; v->iov_len -= w;}
+	}
+	e->niov = 0;
+	e->len = 0;
+	return e->err;
+}
+
+// end of the last slice, or NULL
+char *_emitend (Emitter *e) {
+	if (e->niov == 0){return NULL;}
+	struct iovec *v = &e->iov[e->niov - 1];
+	return (char *) v->iov_base + v->iov_len;
+}
+
+// gathers n bytes at s
+void _emitslice (Emitter *e, char *s, long n) {
+	if (n <= 0){return;}
+	if (_emitend(e) == s){e->iov[e->niov - 1].iov_len += n;}
+	else {
+		if (e->niov >= EmitIovLen){_emitflush(e);}
+		e->iov[e->niov].iov_base = s;
+		e->iov[e->niov++].iov_len = n;
+	}
+	e->col += n;
+	e->last = s[n - 1];
+}
+
+// gathers n bytes of c, from the source if it has them next
+void _emitbytes (Emitter *e, char c, long n) {
+	char *end = _emitend(e);
+	if (end != NULL && end >= e->src && end + n <= e->src + e->srclen){
+		long i = 0;
+		while (i < n && end[i] == c){i++;}
+		if (i == n){_emitslice(e, end, n); return;}
+	}
+	while (n > 0){
+		if (e->len >= EmitBufLen || e->niov >= EmitIovLen){_emitflush(e);}
+		long m = EmitBufLen - e->len < n ? EmitBufLen - e->len : n;
+		memset(&e->buf[e->len], c, m);
+		_emitslice(e, &e->buf[e->len], m);
+		e->len += m;
+		n -= m;
+	}
+}
+
+void _emitline (Emitter *e, long indent) {
+	_emitbytes(e, '\n', 1);
+	_emitbytes(e, ' ', indent);
+	e->col = indent;
+}
+
+int _emitlist (AsTree *tree) {return tree->node == NULL || tree->node->type == itemOp;}
+
+// makes room for frames to depth
+int _emitframes (Emitter *e, int depth) {
+	if (depth < e->maxframe){return 0;}
+	int max = e->maxframe > 0 ? e->maxframe * 2 : 64;
+	while (max <= depth){max *= 2;}
+	EmitFrame *v = grealloc(e->frame, max * sizeof (EmitFrame));
+	if (v == NULL){return 1;}
+	e->frame = v;
+	e->maxframe = max;
+	return 0;
+}
+
+// Measuring
+// before pretty printing, the width of each tree laid out on one
+// line is found leaving it, after its subtrees. Trees are kept in
+// walk order, so emitting a tree whole skips to its end.
+
+int _emitmeasure (AsTree *tree, int depth, int exit, void *v) {
+	Emitter *e = (Emitter *) v;
+	if (_emitframes(e, depth)){return 1;}
+	EmitFrame *m = &e->frame[depth];
+	if (!exit){
+		if (e->nflat >= e->maxflat){
+			long max = e->maxflat > 0 ? e->maxflat * 2 : 1024;
+			EmitFlat *w = grealloc(e->flat, max * sizeof (EmitFlat));
+			if (w == NULL){return 1;}
+			e->flat = w;
+			e->maxflat = max;
+		}
+		m->i = e->nflat++;
+		if (!_emitlist(tree)){m->width = tree->node->len;}
+		else{m->width = tree->node != NULL ? 2 + (long) tree->node->len : 1;} // ( & ), or ( alone without an operator
+		return 0;
+	}
+	if (_emitlist(tree) && tree->node == NULL && tree->len == 0){m->width++;} // ()
+	EmitFlat f = {.width = m->width, .end = e->nflat};
+	e->flat[m->i] = f;
+	if (depth > 0){m[-1].width += 1 + m->width;}
+	return 0;
+}
+
+// Emitting
+// lists the parser found laid out as they are emitted are written
+// as one slice of their source, without reading their subtrees,
+// unless they are too wide for what is left of the line.
+
+int _emittree (Emitter *e, AsTree *root) {
+	if (_emitframes(e, 0)){return 1;}
+	EmitFrame top = {.tree = root};
+	e->frame[0] = top;
+	long next = 1; // index in flat, after the root
+	for (int d = 0; d >= 0 && !e->err;){
+		EmitFrame *f = &e->frame[d];
+		if (f->sub >= f->tree->len){ // leave
+			if (d > 0){_emitbytes(e, ')', 1);}
+			if (d == 1){_emitbytes(e, '\n', 1); e->col = 0;}
+			d--;
+			continue;
+		}
+		AsTree *tree = f->tree->tree[f->sub++];
+		long flat = e->width > 0 ? e->flat[next].width : 0;
+		long end = e->width > 0 ? e->flat[next].end : 0;
+		next++;
+		if (d > 0){
+			if (f->broken){_emitline(e, f->indent + 2);}
+			else if (e->last != '('){_emitbytes(e, ' ', 1);}
+		}
+		Node *n = tree->node;
+		int broken = e->width > 0 && flat > e->width - e->col;
+		if (!_emitlist(tree) || (tree->span > 0 && !broken)){ // whole
+			if (!_emitlist(tree)){_emitslice(e, &e->src[n->off], n->len);}
+			else{_emitslice(e, &e->src[n->off - 1], tree->span); next = end;}
+			if (d == 0){_emitbytes(e, '\n', 1); e->col = 0;}
+			continue;
+		}
+		if (_emitframes(e, ++d)){return 1;}
+		EmitFrame sub = {.tree = tree, .broken = broken, .indent = e->col};
+		e->frame[d] = sub;
+		_emitbytes(e, '(', 1);
+		if (n != NULL){_emitslice(e, &e->src[n->off], n->len);}
+	}
+	return e->err;
+}
+
+// writes the tree at root, slicing src, returning nonzero on error
+int emit (Emitter *e, AsTree *root, char *src, long srclen) {
+	e->src = src;
+	e->srclen = srclen;
+	e->col = 0;
+	e->last = '\n';
+	e->nflat = 0;
+	if (e->width > 0 && walkast(root, _emitmeasure, e)){return 1;}
+	if (_emittree(e, root)){_emitflush(e); return 1;}
+	return _emitflush(e);
+}
+
+#endif // EMIT
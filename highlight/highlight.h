@@ -0,0 +1,53 @@
+#import <stdio.h> // fwrite
+#import "../tok/tok.h" // tokens
+#import "../util/broadcast.h" // Broadcast
+#import "../basilisk.h" // Basilisk type
+
+// Highlighter
+// highlight reads the same tokens as the parser from the token
+// broadcast, writing the source back out with each token coloured
+// by its type; text between tokens is written as it is.
+
+// Include guard.
+#ifndef HIGHLIGHT
+#define HIGHLIGHT
+
+// colour of a token, or NULL for none
+const char *_hlcolor (Token *t, int op) {
+	int type = toktype(t);
+	if (type == itemErr){return "\033[4m\033[31m";}
+	else if (type == itemBeginList || type == itemEndList){return "\033[1m";}
+	else if (type == itemOp && op != opNone){return "\033[1m\033[35m";}
+	else if (type == itemNum){return "\033[36m";}
+	else if (type == itemChar || type == itemStr){return "\033[32m";}
+	return NULL;
+}
+
+void *highlight (void *v) {
+	Basilisk *b = (Basilisk *) v;
+	tracename("highlight");
+	FILE *out = stdout;
+	uint32_t last = 0; // offset written up to
+	for (int eof = 0; !eof;){
+		TokBuf *buf = bnext(b->cast, subHighlight);
+		if (buf == NULL){break;} // cancelled
+		for (int i = 0; i < buf->len; i++){
+			Token t = tokat(buf, i);
+			uint32_t end = t.off + toklen(&t);
+			if (t.off > last){fwrite(&buf->src[last], 1, t.off - last, out); last = t.off;}
+			if (end > last){ // errors may overlap the tokens after them
+				const char *c = _hlcolor(&t, tokop(buf, i));
+				if (c != NULL){fputs(c, out);}
+				fwrite(&buf->src[last], 1, end - last, out);
+				if (c != NULL){fputs("\033[0m", out);}
+				last = end;
+			}
+			if (toktype(&t) == itemEOF){eof = 1; break;} // its text is what was left unlexed
+		}
+	}
+	bdone(b->cast, subHighlight);
+	fflush(out);
+	return NULL;
+}
+
+#endif // HIGHLIGHT
@@ -0,0 +1,496 @@
+#import <stdio.h> // fopen, fread
+#import <stdlib.h> // malloc, qsort
+#import <string.h> // memcmp
+#import <stdint.h> // uint32_t
+#import <fcntl.h> // open
+#import <unistd.h> // close
+#import <sys/mman.h> // mmap
+#import <sys/stat.h> // fstat
+#import "../lex/basilisk-lex.h" // lexer
+#import "../util/thread.h" // concurrency
+#import "../util/hash.h" // fnv & HashTable
+#import "../basilisk.h" // Basilisk type
+
+// Symbol Index
+// a persistent cross reference from every operator & atom the
+// lexer emits to the files and offsets it was lexed at.
+// Files are run through lex() as usual, with xref reading the
+// token stack in place of the parser.
+// Files are only lexed again when their hash changes, so an index
+// can be updated with the files of a tree every time it changes.
+
+// Index file layout, all integers in host order:
+// IndexHead, nfile IndexFile, nsym IndexSym sorted by text,
+// npost IndexPost grouped by symbol, then text of names & symbols.
+
+const char IndexMagic[4] = "BSKX";
+const uint32_t IndexVersion = 1;
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t nfile;
+	uint32_t nsym;
+	uint64_t npost;
+} IndexHead;
+
+typedef struct {
+	uint64_t hash; // hash of file contents
+	uint32_t off; // offset of name in text
+	uint32_t len; // length of name
+} IndexFile;
+
+typedef struct {
+	uint32_t off; // offset of symbol in text
+	uint32_t len; // length of symbol
+	uint64_t post; // first posting
+	uint64_t npost; // number of postings
+} IndexSym;
+
+typedef struct {
+	uint32_t file; // file lexed in
+	uint32_t off; // offset in file
+} IndexPost;
+
+// posting of a symbol id, in memory
+typedef struct {
+	uint32_t sym;
+	uint32_t file;
+	uint32_t off;
+} Posting;
+
+// Index in memory
+typedef struct {
+	char *text; // names & symbols
+	size_t tlen, tmax;
+	IndexSym *sym; // symbols, post unused until written
+	int nsym;
+	long maxsym;
+	HashTable syms; // of sym, by text
+	Posting *post;
+	long npost, maxpost;
+	IndexFile *file;
+	int *live; // is file still indexed?
+	int nfile;
+	long maxfile;
+	HashTable files; // newest file of each name
+} Index;
+
+// text of a symbol or file name, as looked up
+typedef struct {
+	const char *s;
+	uint32_t len;
+} IndexKey;
+
+// grows an array of n elements of size to hold one more
+int _growidx (void **v, long *max, long n, size_t size) {
+	if (n < *max){return 0;}
+	long m = *max > 0 ? *max * 2 : 64;
+	void *p = realloc(*v, m * size);
+	if (p == NULL){return 1;}
+	*v = p; *max = m;
+	return 0;
+}
+
+Index *initindex () {
+	Index *x = calloc(1, sizeof (Index));
+	if (x == NULL){return NULL;}
+	if (inithash(&x->syms, 1024, memStage) || inithash(&x->files, 1024, memStage)){return NULL;}
+	return x;
+}
+
+int freeindex (Index *x) {
+	free(x->text); free(x->sym); freehash(&x->syms);
+	free(x->post); free(x->file); free(x->live); freehash(&x->files);
+	free(x);
+	return 0;
+}
+
+// appends n bytes to text, returning their offset
+long _idxtext (Index *x, const char *s, size_t n) {
+	while (x->tlen + n > x->tmax){
+		size_t max = x->tmax > 0 ? x->tmax * 2 : 4096;
+		char *text = realloc(x->text, max);
+		if (text == NULL){return -1;}
+		x->text = text; x->tmax = max;
+	}
+	memcpy(&x->text[x->tlen], s, n);
+	x->tlen += n;
+	return x->tlen - n;
+}
+
+int _idxsymeq (void *v, long i, const void *key) {
+	Index *x = (Index *) v;
+	const IndexKey *k = key;
+	return x->sym[i].len == k->len && memcmp(&x->text[x->sym[i].off], k->s, k->len) == 0;
+}
+
+// id of symbol s, added if new
+long idxsym (Index *x, const char *s, uint32_t len) {
+	if (hashroom(&x->syms)){return -1;}
+	IndexKey k = {.s = s, .len = len};
+	uint64_t h = fnv(FnvBasis, s, len);
+	long slot = hashfind(&x->syms, h, _idxsymeq, x, &k);
+	if (hashat(&x->syms, slot) >= 0){return hashat(&x->syms, slot);}
+	if (_growidx((void **) &x->sym, &x->maxsym, x->nsym, sizeof (IndexSym))){return -1;}
+	long off = _idxtext(x, s, len);
+	if (off < 0){return -1;}
+	IndexSym sym = {.off = off, .len = len};
+	x->sym[x->nsym] = sym;
+	hashput(&x->syms, slot, h, x->nsym);
+	return x->nsym++;
+}
+
+// adds a posting for symbol s
+int idxpost (Index *x, const char *s, uint32_t len, uint32_t file, uint32_t off) {
+	long sym = idxsym(x, s, len);
+	if (sym < 0){return 1;}
+	if (_growidx((void **) &x->post, &x->maxpost, x->npost, sizeof (Posting))){return 1;}
+	Posting p = {.sym = sym, .file = file, .off = off};
+	x->post[x->npost++] = p;
+	return 0;
+}
+
+int _idxfileeq (void *v, long i, const void *key) {
+	Index *x = (Index *) v;
+	const IndexKey *k = key;
+	return x->file[i].len == k->len && memcmp(&x->text[x->file[i].off], k->s, k->len) == 0;
+}
+
+// slot of file name in files, empty if it was never added
+long _fileslot (Index *x, const char *name, uint32_t len) {
+	IndexKey k = {.s = name, .len = len};
+	return hashfind(&x->files, fnv(FnvBasis, name, len), _idxfileeq, x, &k);
+}
+
+// adds a file, returning its id
+long idxfile (Index *x, const char *name, uint32_t len, uint64_t hash) {
+	if (hashroom(&x->files)){return -1;}
+	if (_growidx((void **) &x->file, &x->maxfile, x->nfile, sizeof (IndexFile))){return -1;}
+	int *live = realloc(x->live, x->maxfile * sizeof (int));
+	if (live == NULL){return -1;}
+	x->live = live;
+	long slot = _fileslot(x, name, len);
+	long off = _idxtext(x, name, len);
+	if (off < 0){return -1;}
+	IndexFile f = {.hash = hash, .off = off, .len = len};
+	x->file[x->nfile] = f;
+	x->live[x->nfile] = 1;
+	hashput(&x->files, slot, fnv(FnvBasis, name, len), x->nfile); // newest file of this name
+	return x->nfile++;
+}
+
+// id of the live file named name, or -1
+long findfile (Index *x, const char *name) {
+	long i = hashat(&x->files, _fileslot(x, name, strlen(name)));
+	if (i < 0 || !x->live[i]){return -1;}
+	return i;
+}
+
+// Index files on disk are mapped whole, nothing is copied to
+// look a symbol up.
+
+typedef struct {
+	void *map;
+	size_t size;
+	IndexHead *head;
+	IndexFile *file;
+	IndexSym *sym;
+	IndexPost *post;
+	char *text;
+} IndexMap;
+
+// is the slice off, len inside n bytes?
+int _inside (uint64_t off, uint64_t len, uint64_t n) {return off <= n && len <= n - off;}
+
+// are the sections & records of m inside it? Every record is
+// checked, so a damaged index is never read out of bounds.
+int _checkindex (IndexMap *m) {
+	IndexHead *h = m->head;
+	size_t left = m->size - sizeof (IndexHead);
+	if (h->nfile > left / sizeof (IndexFile)){return 1;}
+	left -= h->nfile * sizeof (IndexFile);
+	if (h->nsym > left / sizeof (IndexSym)){return 1;}
+	left -= h->nsym * sizeof (IndexSym);
+	if (h->npost > left / sizeof (IndexPost)){return 1;}
+	left -= h->npost * sizeof (IndexPost);
+	m->file = (IndexFile *) (h + 1);
+	m->sym = (IndexSym *) (m->file + h->nfile);
+	m->post = (IndexPost *) (m->sym + h->nsym);
+	m->text = (char *) (m->post + h->npost);
+	for (uint32_t i = 0; i < h->nfile; i++){
+		if (!_inside(m->file[i].off, m->file[i].len, left)){return 1;}
+	}
+	for (uint32_t i = 0; i < h->nsym; i++){
+		IndexSym *s = &m->sym[i];
+		if (!_inside(s->off, s->len, left) || !_inside(s->post, s->npost, h->npost)){return 1;}
+	}
+	for (uint64_t i = 0; i < h->npost; i++){
+		if (m->post[i].file >= h->nfile){return 1;}
+	}
+	return 0;
+}
+
+// maps an index file, returns 1 if it does not exist or is not an index
+int mapindex (IndexMap *m, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0){return 1;}
+	struct stat st;
+	if (fstat(fd, &st) || (size_t) st.st_size < sizeof (IndexHead)){close(fd); return 1;}
+	m->size = st.st_size;
+	m->map = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (m->map == MAP_FAILED){return 1;}
+
+	m->head = m->map;
+	if (memcmp(m->head->magic, IndexMagic, 4) || m->head->version != IndexVersion || _checkindex(m)){
+		munmap(m->map, m->size); return 1;
+	}
+	return 0;
+}
+
+void unmapindex (IndexMap *m) {munmap(m->map, m->size);}
+
+// symbol s in a mapped index, by binary search, or NULL
+IndexSym *lookup (IndexMap *m, const char *s, uint32_t len) {
+	long lo = 0, hi = (long) m->head->nsym - 1;
+	while (lo <= hi){
+		long mid = (lo + hi) / 2;
+		IndexSym *sym = &m->sym[mid];
+		uint32_t n = sym->len < len ? sym->len : len;
+		int c = memcmp(&m->text[sym->off], s, n);
+		if (c == 0){c = (sym->len > len) - (sym->len < len);}
+		if (c == 0){return sym;}
+		else if (c < 0){lo = mid + 1;}
+		else{hi = mid - 1;}
+	}
+	return NULL;
+}
+
+// loads a mapped index into memory to be updated
+int loadindex (Index *x, IndexMap *m) {
+	for (uint32_t i = 0; i < m->head->nfile; i++){
+		IndexFile *f = &m->file[i];
+		if (idxfile(x, &m->text[f->off], f->len, f->hash) < 0){return 1;}
+	}
+	for (uint32_t i = 0; i < m->head->nsym; i++){
+		IndexSym *s = &m->sym[i];
+		for (uint64_t j = s->post; j < s->post + s->npost; j++){
+			IndexPost *p = &m->post[j];
+			if (idxpost(x, &m->text[s->off], s->len, p->file, p->off)){return 1;}
+		}
+	}
+	return 0;
+}
+
+// postings are written grouped by symbol in text order: symbols are
+// sorted by text as keys, then postings by the rank of their symbol
+typedef struct {
+	const char *s; // text of the symbol
+	uint32_t len;
+	int sym; // its id
+} SymKey;
+
+int _cmpsym (const void *a, const void *b) {
+	const SymKey *s = a, *t = b;
+	uint32_t n = s->len < t->len ? s->len : t->len;
+	int c = memcmp(s->s, t->s, n);
+	if (c == 0){c = (s->len > t->len) - (s->len < t->len);}
+	return c;
+}
+
+// postings by the rank of their symbol, held in sym while sorting
+int _cmppost (const void *a, const void *b) {
+	const Posting *p = a, *q = b;
+	if (p->sym != q->sym){return p->sym < q->sym ? -1 : 1;}
+	if (p->file != q->file){return p->file < q->file ? -1 : 1;}
+	return (p->off > q->off) - (p->off < q->off);
+}
+
+// writes an index, dropping files that are no longer live.
+// It is written beside path and renamed over it, so readers never
+// see half an index.
+int writeindex (Index *x, const char *path) {
+	// renumber live files
+	int *fid = malloc((x->nfile + 1) * sizeof (int));
+	int *order = malloc((x->nsym + 1) * sizeof (int));
+	int *rank = malloc((x->nsym + 1) * sizeof (int));
+	SymKey *key = malloc((x->nsym + 1) * sizeof (SymKey));
+	if (fid == NULL || order == NULL || rank == NULL || key == NULL){return 1;}
+	uint32_t nfile = 0;
+	for (int i = 0; i < x->nfile; i++){fid[i] = x->live[i] ? (int) nfile++ : -1;}
+
+	// drop dead postings & sort the rest
+	long npost = 0;
+	for (long i = 0; i < x->npost; i++){
+		if (fid[x->post[i].file] < 0){continue;}
+		x->post[npost] = x->post[i];
+		x->post[npost++].file = fid[x->post[i].file];
+	}
+	for (int i = 0; i < x->nsym; i++){
+		SymKey k = {.s = &x->text[x->sym[i].off], .len = x->sym[i].len, .sym = i};
+		key[i] = k;
+	}
+	qsort(key, x->nsym, sizeof (SymKey), _cmpsym);
+	for (int i = 0; i < x->nsym; i++){order[i] = key[i].sym; rank[key[i].sym] = i;}
+	for (long i = 0; i < npost; i++){x->post[i].sym = rank[x->post[i].sym];}
+	qsort(x->post, npost, sizeof (Posting), _cmppost);
+	for (long i = 0; i < npost; i++){x->post[i].sym = order[x->post[i].sym];}
+
+	// count postings of each symbol, dropping symbols without any
+	for (int i = 0; i < x->nsym; i++){x->sym[i].npost = 0;}
+	for (long i = 0; i < npost; i++){x->sym[x->post[i].sym].npost++;}
+	uint32_t nsym = 0;
+	uint64_t post = 0;
+	for (int i = 0; i < x->nsym; i++){
+		IndexSym *s = &x->sym[order[i]];
+		if (s->npost == 0){continue;}
+		s->post = post; post += s->npost;
+		order[nsym++] = order[i];
+	}
+
+	char tmp[4096];
+	snprintf(tmp, sizeof tmp, "%s.tmp", path);
+	FILE *f = fopen(tmp, "w");
+	if (f == NULL){return 1;}
+	IndexHead head = {.version = IndexVersion, .nfile = nfile, .nsym = nsym, .npost = npost};
+	memcpy(head.magic, IndexMagic, 4);
+	fwrite(&head, sizeof head, 1, f);
+	for (int i = 0; i < x->nfile; i++){
+		if (x->live[i]){fwrite(&x->file[i], sizeof (IndexFile), 1, f);}
+	}
+	for (uint32_t i = 0; i < nsym; i++){fwrite(&x->sym[order[i]], sizeof (IndexSym), 1, f);}
+	for (long i = 0; i < npost; i++){
+		IndexPost p = {.file = x->post[i].file, .off = x->post[i].off};
+		fwrite(&p, sizeof p, 1, f);
+	}
+	fwrite(x->text, 1, x->tlen, f);
+	free(fid); free(order); free(rank); free(key);
+	if (ferror(f)){fclose(f); return 1;}
+	if (fclose(f)){return 1;}
+	return rename(tmp, path);
+}
+
+// Indexer
+// xref takes the parser's place, reading tokens as they are lexed.
+
+typedef struct {
+	Basilisk *b;
+	Index *x;
+	uint32_t file; // id of file being lexed
+	int err; // did indexing fail?
+} Indexer;
+
+void *xref (void *v) {
+	Indexer *ix = (Indexer *) v;
+	tracename("xref");
+	TokBuf *buf;
+	int eof = 0;
+	while (!eof && (buf = mnext(ix->b->tok)) != NULL){
+		for (int i = 0; i < buf->len; i++){
+			Token t = tokat(buf, i);
+			int type = toktype(&t);
+			if (type == itemEOF){eof = 1; break;}
+			if (type != itemOp && type != itemNum && type != itemChar && type != itemStr){continue;}
+			if (idxpost(ix->x, &buf->src[t.off], toklen(&t), ix->file, t.off)){ix->err = 1;}
+		}
+		freetokbuf(buf);
+	}
+	return NULL;
+}
+
+// hash of a file's contents
+int hashfile (const char *name, uint64_t *hash) {
+	FILE *f = fopen(name, "r");
+	if (f == NULL){return 1;}
+	char buf[1 << 16];
+	size_t n;
+	*hash = FnvBasis;
+	while ((n = fread(buf, 1, sizeof buf, f)) > 0){*hash = fnv(*hash, buf, n);}
+	int err = ferror(f);
+	fclose(f);
+	return err;
+}
+
+// lex one file into the index
+int idxlex (Index *x, const char *name, uint32_t file) {
+	Basilisk b = {.name = (char *) name};
+	b.stream = fopen(name, "r");
+	if (b.stream == NULL){return 1;}
+	b.tok = initmstack();
+	b.src = initstack();
+	Stack *stack = initstack();
+	if (b.tok == NULL || b.src == NULL || stack == NULL){return 1;}
+
+	Indexer ix = {.b = &b, .x = x, .file = file};
+	pspawn(stack, lex, (void *) &b);
+	pspawn(stack, xref, (void *) &ix);
+	for (int i = 0; i < 2; i++){pwait(stack);}
+
+	char *src;
+	while ((src = pop(b.src)) != NULL){gfree(src);}
+	freestack(b.src);
+	freemstack(b.tok);
+	freestack(stack);
+	fclose(b.stream);
+	return ix.err;
+}
+
+// updates the index at path with files, lexing only those
+// that are new or have changed since they were last indexed.
+// Indexed files that cannot be read any more are dropped, whether
+// or not they are in files, so deleted files leave the index.
+int buildindex (const char *path, char **files, int n) {
+	Index *x = initindex();
+	if (x == NULL){gperr(); return 1;}
+	IndexMap m;
+	if (mapindex(&m, path) == 0){
+		int err = loadindex(x, &m);
+		unmapindex(&m);
+		if (err){gperr(); return 1;}
+	}
+	int dropped = 0;
+	for (int i = 0; i < x->nfile; i++){
+		char name[4096];
+		snprintf(name, sizeof name, "%.*s", (int) x->file[i].len, &x->text[x->file[i].off]);
+		if (access(name, R_OK) != 0){x->live[i] = 0; dropped++;}
+	}
+
+	int lexed = 0;
+	for (int i = 0; i < n; i++){
+		uint64_t hash;
+		long file = findfile(x, files[i]);
+		if (hashfile(files[i], &hash)){
+			if (file >= 0){x->live[file] = 0;} // gone, drop it
+			gperr(); continue;
+		}
+		if (file >= 0 && x->file[file].hash == hash){continue;} // unchanged
+		if (file >= 0){x->live[file] = 0;}
+		file = idxfile(x, files[i], strlen(files[i]), hash);
+		if (file < 0 || idxlex(x, files[i], file)){gperr(); return 1;}
+		lexed++;
+	}
+
+	if (writeindex(x, path)){gperr(); return 1;}
+	char str[100];
+	snprintf(str, sizeof str, "indexed %d of %d files, %d symbols, dropped %d files.", lexed, n, x->nsym, dropped);
+	gnote(str);
+	freeindex(x);
+	return 0;
+}
+
+// prints the postings of each symbol as file:offset
+int lookupsyms (const char *path, char **syms, int n) {
+	IndexMap m;
+	if (mapindex(&m, path)){gerr("no index"); return 1;}
+	for (int i = 0; i < n; i++){
+		IndexSym *s = lookup(&m, syms[i], strlen(syms[i]));
+		if (s == NULL){continue;}
+		for (uint64_t j = s->post; j < s->post + s->npost; j++){
+			IndexFile *f = &m.file[m.post[j].file];
+			printf("%.*s:%u\t%s\n", (int) f->len, &m.text[f->off], m.post[j].off, syms[i]);
+		}
+	}
+	unmapindex(&m);
+	return 0;
+}
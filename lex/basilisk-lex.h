@@ -2,8 +2,13 @@
 #import <stdlib.h> // calloc, exit
 #import <signal.h> // signal handler
 #import <ctype.h> // isalnum()
+#import <string.h> // strchr
+#if defined(__SSE2__)
+#import <emmintrin.h> // _mm_cmpeq_epi8
+#endif
 #import "../tok/tok.h" // token header
 #import "../lex/lex.h" // lexical scanning library.
+#import "literal.h" // string & char literals
 #import "../util/state.h" // state machine
 #import "../basilisk.h" // Basilisk type
 
@@ -17,6 +22,12 @@
 // is s a space character?
 int isseparator (char s) {return s == ' ' || s == '\t' || s == '\n';}
 
+// is s the beginning of a comment?
+int iscomment (char s) {return s == ';';}
+
+// can s be part of an operator?
+int isopchar (char s) {return isalnum((unsigned char) s) || (s != '\0' && strchr("+-*/%<>=!?_&|^~.:@$", s) != NULL);}
+
 // are there characters not emitted?
 int unemitted (Lexer *l) {return l->e > l->b;}
 
@@ -28,34 +39,86 @@ const int lexnNum = 3;
 const int lexnChar = 4;
 const int lexnStr = 5;
 
+// skip a run of separators & comments beginning with c,
+// they become trivia of the next token instead of being emitted.
+void lskip (Lexer *l, int c) {
+	while (c != EOF) {
+		if (iscomment(c)){
+			while ((c = lnext(l)) != EOF && c != '\n'){}
+		} else if (!isseparator(c)){lbackup(l); break;}
+		else{c = lnext(l);}
+	}
+	ldump(l);
+}
+
 // list characters
 const char beginList = '(';
 const char endList = ')';
 
+// Recovery
+// a run of bytes that cannot begin a token, such as binary data or
+// a mangled paste, is one error: it is skipped whole to the next
+// paren or newline, where lexing picks up again.
+
+// offset of the next paren or newline at or after i, or n
+int _lexsync (const char *s, int i, int n) {
+#if defined(__SSE2__)
+	const __m128i paren = _mm_set1_epi8(')'); // ( is ) with the low bit clear
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i nl = _mm_set1_epi8('\n');
+	for (; i + 16 <= n; i += 16){
+		__m128i v = _mm_loadu_si128((const __m128i *) &s[i]);
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(_mm_or_si128(v, one), paren), _mm_cmpeq_epi8(v, nl));
+		int bits = _mm_movemask_epi8(m);
+		if (bits){return i + __builtin_ctz(bits);}
+	}
+#endif
+	for (; i < n; i++){
+		if (s[i] == '(' || s[i] == ')' || s[i] == '\n'){return i;}
+	}
+	return n;
+}
+
+// can c begin nothing?
+int isbad (int c) {return c != EOF && !isseparator(c) && !iscomment(c) && !isopchar(c) && !isdigit(c) && (c == '\0' || strchr("()\"'", c) == NULL);}
+
+// skips the invalid run begun at b, reporting it as one error
+int lskipbad (Lexer *l) {
+	long max = (long) l->b + TokLenMax; // longest an error token can be
+	for (;;){
+		int end = l->n < max ? l->n : (int) max;
+		l->e = _lexsync(l->str, l->e, end);
+		if (l->e < l->n || l->e >= max || lfill(l)){break;}
+	}
+	char str[40];
+	unsigned char c = l->str[l->b];
+	if (l->e - l->b > 1){snprintf(str, sizeof str, "%d unexpected bytes", l->e - l->b);}
+	else if (isprint(c)){snprintf(str, sizeof str, "unexpected character: %c", c);}
+	else{snprintf(str, sizeof str, "unexpected byte: 0x%02x", c);}
+	int err = lerr(l, str);
+	ldump(l);
+	return err;
+}
+
 // list stuff
 int lexList (void *v) {
 	Lexer *l = (Lexer *) v;
-	char c;
+	int c;
 	while((c = lnext(l)) != EOF) {
 		if (c == beginList) {
 			l->parenDepth++;
 			lemit(l, itemBeginList);
 			return lexnOp;
 		} else if (c == endList) {
+			// a stray ) is only an error, the parser never sees it
+			if (l->parenDepth == 0){lerr(l, "too many parens"); ldump(l); return lexnList;}
 			l->parenDepth--;
 			lemit(l, itemEndList);
-			if (l->parenDepth < 0) {
-				lerr(l, "too many parens"); ldump(l); l->parenDepth++;
-				return lexnList;}
-			else if (l->parenDepth == 0){return lexnList;}
-			else{return lexnList;}
-		} else if (isseparator(c)){
-			lemit(l, itemSeparator);
 			return lexnList;
-		} else {
-			char str[] = "unexpected character: %c";
-			sprintf(str, str, l->str[l->b]);
-			lerr(l, str); ldump(l);}
+		} else if (isseparator(c) || iscomment(c)){
+			lskip(l, c);
+			return lexnList;
+		} else{lskipbad(l);}
 	}
 	return -1;
 }
@@ -63,12 +126,13 @@ int lexList (void *v) {
 // lex operator
 int lexOp (void *v) {
 	Lexer *l = (Lexer *) v;
-	char c;
+	int c;
 	while((c = lnext(l)) != EOF) {
-		// eat alphanumeric
-		if (!isalnum(c)) {
+		// eat operator characters, builtins are tagged with their id
+		if (!isopchar(c)) {
 			lbackup(l);
-			if (unemitted(l)){lemit(l, itemOp);}
+			if (unemitted(l)){lemitop(l, itemOp, opid(&l->str[l->b], l->e - l->b));}
+			else if (isbad(c)){lnext(l); lskipbad(l);} // one error for both
 			else{lerr(l, "list missing an operator");}
 			return lexnAtom;
 		}
@@ -79,14 +143,14 @@ int lexOp (void *v) {
 // lexes atoms of any type
 int lexAtom (void *v) {
 	Lexer *l = (Lexer *) v;
-	char c;
+	int c;
 	while((c = lnext(l)) != EOF) {
-		if (c < '9' && c > '0'){return lexnNum;}
+		if (c >= '0' && c <= '9'){return lexnNum;}
 		else if (c == '\''){return lexnChar;}
 		else if (c == '\"'){return lexnStr;}
 		else if (c == ')' || c == '('){lbackup(l); return lexnList;}
-		else if (isseparator(c)){lemit(l, itemSeparator);}
-		else{lerr(l, "unexpected chracter");}
+		else if (isseparator(c) || iscomment(c)){lskip(l, c);}
+		else{lskipbad(l);}
 	}
 	lerr(l, "unexpected EOF");
 	return -1;
@@ -94,7 +158,7 @@ int lexAtom (void *v) {
 
 int lexNum (void *v) {
 	Lexer *l = (Lexer *) v;
-	char c;
+	int c;
 	while((c = lnext(l)) != EOF) {
 		// eat number
 		if (c > '9' || c < '0') {
@@ -107,33 +171,31 @@ int lexNum (void *v) {
 	return -1;
 }
 
-int lexChar (void *v) {
-	Lexer *l = (Lexer *) v;
-	char c;
-	while((c = lnext(l)) != EOF) {
-		// eat char
-		if (c == '\'') {
-			if (unemitted(l)){lemit(l, itemChar);}
-			else{lerr(l, "not a character");}
-			return lexnAtom;
+// lexes a literal of type closed by q, its opening q read.
+// Its text is scanned in place, a block of input at a time.
+int _lexlit (Lexer *l, char q, int type) {
+	int flags = 0;
+	uint32_t i = litscan(l->str, l->e, l->n, q, &flags);
+	while (!(flags & litClosed)){
+		if (lfill(l)){
+			if (cancelled(l->cancel)){return -1;}
+			l->e = l->n;
+			lerr(l, type == itemStr ? "unclosed string" : "unclosed character"); ldump(l);
+			return -1;
 		}
+		i = litscan(l->str, i, l->n, q, &flags);
 	}
-	return -1;
+	l->e = i + 1;
+	if (flags & litBadUtf8){lerr(l, "invalid UTF-8"); ldump(l);}
+	else if (flags & litBadEscape){lerr(l, "unknown escape"); ldump(l);}
+	else if (l->e - l->b == 2 && type == itemChar){lerr(l, "not a character"); ldump(l);}
+	else{lemit(l, type);}
+	return lexnAtom;
 }
 
-int lexStr (void *v) {
-	Lexer *l = (Lexer *) v;
-	char c;
-	while((c = lnext(l)) != EOF) {
-		// eat string
-		if (c == '\"') {
-			if (unemitted(l)){lemit(l, itemStr);}
-			else{lerr(l, "not a string");}
-			return lexnAtom;
-		}
-	}
-	return -1;
-}
+int lexChar (void *v) {return _lexlit((Lexer *) v, '\'', itemChar);}
+
+int lexStr (void *v) {return _lexlit((Lexer *) v, '"', itemStr);}
 
 // Lexer init
 // lexers is an array of all lexers
@@ -141,36 +203,84 @@ int lexStr (void *v) {
 // calling the state returned by the last state function
 // until that state is -1, then exiting.
 
+// sets l up to lex b, nonzero if it cannot. What it could not finish
+// is undone here, what it did is undone as a lex is.
+int _lexopen (Basilisk *b, Lexer *l) {
+	// lex a buffer in place, or read the stream into str,
+	// reusing the str & input left by the last lex.
+	if (b->buf != NULL){
+		l->str = b->buf;
+		l->length = l->n = b->buflen;
+		l->b = l->e = l->tb = b->bufoff;
+	} else {
+		if (b->str != NULL){l->str = b->str; l->length = b->strlen; b->str = NULL;}
+		else{l->str = gcalloc(l->length, sizeof (char));} // zeroed memory
+		if (l->str == NULL) {gperr(); return 1;}
+		Input *in = b->in != NULL ? b->in : initinput();
+		if (in == NULL){gperr(); return 1;}
+		in->cancel = l->cancel;
+		int err = 0;
+		if (cancelwatch(l->cancel, &in->lock, &in->cond)){gerr("too many waits to cancel"); err = 1;}
+		else if (startinput(in, l->stream)){gerr("could not read input"); err = 1;}
+		if (err){
+			cancelunwatch(l->cancel, &in->cond);
+			if (b->in == NULL){freeinput(in);}
+			return 1;
+		}
+		l->in = in;
+	}
+	l->buf = taketokbuf(l->spare, l->trivia);
+	if (l->buf == NULL){gperr(); return 1;}
+	return 0;
+}
+
+// lexes b, returning NULL, or b if it could not start: the run is
+// then cancelled, so the threads waiting on tokens return.
 void *lex (void *v) {
 	Basilisk *b = (Basilisk *) v;
+	tracename("lex");
+	govern(&b->gov, memLex);
 
 	// Init lexer on stack memory
 	Lexer l = {
-		.length = 100, // set length to 100
-		.lineNum = 1, // first line
+		.length = 4096, // set length to a page
 		.errstream = stderr
 	};
 
-	l.err = initstack();
-	if (l.err == NULL){gperr(); return NULL;}
-
 	l.tok = b->tok;
-
-	// allocate l.length characters of space
-	l.str = calloc(l.length, sizeof (char)); // zeroed memory
-	if (l.str == NULL) {gperr(); return NULL;}
-
+	l.cast = b->cast;
+	l.cancel = b->cancel;
+	l.old = b->src;
+	l.spare = b->spare;
+	l.trivia = b->trivia;
 	l.name = b->name;
 	l.stream = b->stream;
 
-	// Set up lex func array
-	stateFun lexers[] = {lexList, lexAtom, lexOp, lexNum, lexChar, lexStr};
+	int err = _lexopen(b, &l);
+	if (err){cancel(l.cancel);}
+	else{
+		// Set up lex func array
+		stateFun lexers[] = {lexList, lexAtom, lexOp, lexNum, lexChar, lexStr};
 
-	state(lexers, &l);
+		state(lexers, &l, l.cancel);
+		b->dropped = l.errors > LexErrMax + 1 ? l.errors - LexErrMax - 1 : 0;
 
-	lemit(&l, itemEOF);
+		lemit(&l, itemEOF);
+		lflush(&l);
+	}
 
 	// Free all resource, nothing can escape!
-	free(l.str); // do not free Basilisk resources though.
-	return NULL;
+	if (l.buf != NULL){givetokbuf(l.spare, l.buf);} // do not free Basilisk resources though.
+	b->text = l.str;
+	b->textlen = l.n;
+	if (l.in != NULL){
+		cancelunwatch(l.cancel, &l.in->cond);
+		stopinput(l.in);
+		if (b->in == NULL){freeinput(l.in);}
+	}
+	if (b->buf == NULL && l.str != NULL){
+		push(l.old, l.str); // tokens slice str, freed by main.
+		b->strlen = l.length;
+	}
+	return err ? b : NULL;
 }
\ No newline at end of file
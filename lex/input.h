@@ -0,0 +1,259 @@
+#import <stdio.h> // fread
+#import <stdlib.h> // malloc
+#import <string.h> // memcpy
+#import <pthread.h>
+#import "../util/gerr.h" // general errors
+#import "../util/trace.h" // tracing
+#import "../util/govern.h" // gmalloc
+#import "../util/cancel.h" // Cancel
+
+// Input
+// input is read, and decompressed if need be, on its own thread a
+// block at a time. There are two blocks: while the lexer reads one
+// the other is filled, so reading overlaps lexing.
+// An Input reads one stream at a time, between startinput and
+// stopinput; its blocks are kept to read the next.
+// The format is found from the first bytes of the stream, each
+// format has a read function filling a block from the stream.
+
+#if __has_include(<zlib.h>)
+#import <zlib.h> // gzip
+#define INPUT_GZIP
+#endif
+#if __has_include(<zstd.h>)
+#import <zstd.h> // zstd
+#define INPUT_ZSTD
+#endif
+
+const int InputBufLen = 1 << 18;
+
+// magic bytes
+const unsigned char gzipMagic[] = {0x1f, 0x8b};
+const unsigned char zstdMagic[] = {0x28, 0xb5, 0x2f, 0xfd};
+
+typedef struct Input Input;
+
+// fills buf with up to len bytes, returning how many, 0 at the end
+// of input or -1 on error.
+typedef long (*inputFun) (Input *in, char *buf, long len);
+
+struct Input {
+	FILE *stream;
+	inputFun read; // read function for format
+	unsigned char *raw; // compressed bytes read from stream
+	long rawlen; // raw bytes read
+	long rawpos; // raw bytes used
+	void *dec; // decoder state
+	int member; // is a gzip member begun & not ended?
+	char *buf[2]; // blocks
+	long len[2]; // length of each block
+	int full[2]; // is block ready for the lexer?
+	int r; // block being read by the lexer
+	int held; // does the lexer hold block r?
+	int stop; // lexer is done, stop reading
+	int err; // reading failed
+	Cancel *cancel; // inext ends the input once cancelled, or NULL
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t th;
+};
+
+// next raw bytes from the stream, 0 at the end of the stream
+long _inputraw (Input *in) {
+	if (in->rawpos < in->rawlen){return in->rawlen - in->rawpos;}
+	in->rawpos = 0;
+	in->rawlen = fread(in->raw, 1, InputBufLen, in->stream);
+	if (in->rawlen == 0 && ferror(in->stream)){return -1;}
+	return in->rawlen;
+}
+
+// uncompressed input
+long _inputplain (Input *in, char *buf, long len) {
+	long n = _inputraw(in);
+	if (n <= 0){return n;}
+	if (n > len){n = len;}
+	memcpy(buf, &in->raw[in->rawpos], n);
+	in->rawpos += n;
+	return n;
+}
+
+#ifdef INPUT_GZIP
+// gzip input, concatenated members are read as one.
+// The stream ending inside a member is an error, not a shorter input.
+long _inputgzip (Input *in, char *buf, long len) {
+	z_stream *z = in->dec;
+	z->next_out = (Bytef *) buf;
+	z->avail_out = len;
+	while (z->avail_out > 0){
+		long n = _inputraw(in);
+		if (n < 0){return -1;}
+		if (n == 0 && in->member){gerr("truncated gzip input"); return -1;}
+		if (n == 0){break;}
+		z->next_in = &in->raw[in->rawpos];
+		z->avail_in = n;
+		in->member = 1;
+		int err = inflate(z, Z_NO_FLUSH);
+		in->rawpos += n - z->avail_in;
+		if (err == Z_STREAM_END){inflateReset(z); in->member = 0;}
+		else if (err != Z_OK && err != Z_BUF_ERROR){return -1;}
+	}
+	return len - z->avail_out;
+}
+#endif
+
+#ifdef INPUT_ZSTD
+// zstd input
+long _inputzstd (Input *in, char *buf, long len) {
+	ZSTD_outBuffer out = {.dst = buf, .size = len, .pos = 0};
+	while (out.pos < out.size){
+		long n = _inputraw(in);
+		if (n < 0){return -1;}
+		if (n == 0){break;}
+		ZSTD_inBuffer zin = {.src = &in->raw[in->rawpos], .size = n, .pos = 0};
+		size_t err = ZSTD_decompressStream(in->dec, &out, &zin);
+		in->rawpos += zin.pos;
+		if (ZSTD_isError(err)){return -1;}
+	}
+	return out.pos;
+}
+#endif
+
+// picks the read function from the first bytes of the stream
+int _inputformat (Input *in) {
+	long n = _inputraw(in);
+	if (n < 0){return 1;}
+	in->read = _inputplain;
+	in->dec = NULL;
+	if (n >= 2 && memcmp(in->raw, gzipMagic, 2) == 0){
+#ifdef INPUT_GZIP
+		z_stream *z = calloc(1, sizeof (z_stream));
+		if (z == NULL || inflateInit2(z, 15 + 32) != Z_OK){return 1;} // 32, detect header
+		in->dec = z;
+		in->read = _inputgzip;
+#else
+		gerr("gzip input is not supported by this build");
+		return 1;
+#endif
+	} else if (n >= 4 && memcmp(in->raw, zstdMagic, 4) == 0){
+#ifdef INPUT_ZSTD
+		in->dec = ZSTD_createDStream();
+		if (in->dec == NULL){return 1;}
+		in->read = _inputzstd;
+#else
+		gerr("zstd input is not supported by this build");
+		return 1;
+#endif
+	}
+	return 0;
+}
+
+// finds the format, then fills blocks until the end of input.
+// Once cancelled, stopinput cancels the thread too, which may only
+// happen while it reads, as a read of a pipe may never end.
+void *_inputfill (void *v) {
+	Input *in = (Input *) v;
+	tracename("input");
+	int err = _inputformat(in); // reads, so may be cancelled
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	if (err){
+		pthread_mutex_lock(&in->lock);
+		in->err = 1;
+		in->full[0] = 1;
+		pthread_cond_broadcast(&in->cond);
+		pthread_mutex_unlock(&in->lock);
+		return NULL;
+	}
+	for (int w = 0;; w ^= 1){
+		pthread_mutex_lock(&in->lock);
+		while (in->full[w] && !in->stop){pthread_cond_wait(&in->cond, &in->lock);}
+		int stop = in->stop;
+		pthread_mutex_unlock(&in->lock);
+		if (stop){break;}
+
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		long n = in->read(in, in->buf[w], InputBufLen);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		pthread_mutex_lock(&in->lock);
+		in->err = n < 0;
+		in->len[w] = n < 0 ? 0 : n;
+		in->full[w] = 1;
+		pthread_cond_broadcast(&in->cond);
+		pthread_mutex_unlock(&in->lock);
+		if (n <= 0){break;}
+	}
+	return NULL;
+}
+
+Input *initinput () {
+	Input *in = gcalloc(1, sizeof (Input));
+	if (in == NULL){return NULL;}
+	in->raw = gmalloc(InputBufLen);
+	in->buf[0] = gmalloc(InputBufLen);
+	in->buf[1] = gmalloc(InputBufLen);
+	if (in->raw == NULL || in->buf[0] == NULL || in->buf[1] == NULL){return NULL;}
+	pthread_mutex_init(&in->lock, NULL);
+	pthread_cond_init(&in->cond, NULL);
+	return in;
+}
+
+// starts reading stream
+int startinput (Input *in, FILE *stream) {
+	in->stream = stream;
+	in->rawlen = 0; in->rawpos = 0;
+	in->full[0] = 0; in->full[1] = 0;
+	in->r = 0; in->held = 0; in->stop = 0; in->err = 0;
+	in->read = _inputplain; in->dec = NULL; in->member = 0;
+	return pthread_create(&in->th, NULL, _inputfill, in);
+}
+
+// stops reading, the stream is left open,
+// where it was left if a read was cancelled.
+int stopinput (Input *in) {
+	pthread_mutex_lock(&in->lock);
+	in->stop = 1;
+	pthread_cond_broadcast(&in->cond);
+	pthread_mutex_unlock(&in->lock);
+	if (cancelled(in->cancel)){pthread_cancel(in->th);} // a read may never end
+	pthread_join(in->th, NULL);
+
+#ifdef INPUT_GZIP
+	if (in->read == _inputgzip){inflateEnd(in->dec); free(in->dec);}
+#endif
+#ifdef INPUT_ZSTD
+	if (in->read == _inputzstd){ZSTD_freeDStream(in->dec);}
+#endif
+	in->dec = NULL;
+	return 0;
+}
+
+int freeinput (Input *in) {
+	pthread_mutex_destroy(&in->lock);
+	pthread_cond_destroy(&in->cond);
+	gfree(in->raw); gfree(in->buf[0]); gfree(in->buf[1]);
+	gfree(in);
+	return 0;
+}
+
+// hands the last block back and waits for the next,
+// returning its length, 0 at the end of input or once cancelled,
+// or -1 on error.
+long inext (Input *in, char **blk) {
+	pthread_mutex_lock(&in->lock);
+	if (in->held && in->len[in->r] > 0){
+		in->full[in->r] = 0;
+		in->r ^= 1;
+		pthread_cond_broadcast(&in->cond);
+	}
+	while (!in->full[in->r] && !cancelled(in->cancel)){
+		trace("input wait", traceBegin, in->r);
+		pthread_cond_wait(&in->cond, &in->lock);
+		trace("input wait", traceEnd, in->r);
+	}
+	if (cancelled(in->cancel)){pthread_mutex_unlock(&in->lock); return 0;}
+	in->held = 1;
+	*blk = in->buf[in->r];
+	long n = in->err ? -1 : in->len[in->r];
+	pthread_mutex_unlock(&in->lock);
+	return n;
+}
@@ -1,7 +1,10 @@
 #import <stdio.h> // stdio for printing.
+#import <string.h> // memcpy
 #import "../util/gerr.h" // general errors
 #import "../tok/tok.h" // tokens
 #import "../util/concurrent.h" // MutexStack
+#import "../util/broadcast.h" // Broadcast
+#import "input.h" // input blocks
 
 // Copyright (c) 2014 by Connor Taffe, licensed under
 // the MIT license.
@@ -18,23 +21,57 @@
 // Lexer struct
 typedef struct {
 	FILE *stream; // stream of file
+	Input *in; // input read from stream
 	FILE *errstream; // stream to error
 	char *name; // name of file
 	char *str; // string read
 	int e; // end of string
+	int n; // characters read into string
 	int b; // begenning of string
+	int tb; // beginning of trivia before b
 	int length; // length of str
-	int lineNum; // line number
 	int parenDepth; // depth of parenthesis
-	Stack *err; // error buffer
+	int trivia; // keep trivia of tokens
+	TokPool *spare; // spare token buffers, or NULL
+	Stack *old; // retired strs, tokens may still slice them
+	TokBuf *buf; // tokens not yet sent
 	MutexStack *tok; // token stack
+	Broadcast *cast; // token broadcast, or NULL to push to tok
+	Cancel *cancel; // ends the input once cancelled, or NULL
+	int errors; // errors found, of which LexErrMax are reported
 
 } Lexer;
 
-// error emit
+// errors reported per file, the rest are only counted
+const int LexErrMax = 100;
+
+// Flush
+// tokens are buffered and sent to the token stack in bulk,
+// they slice str so str is sent along with them.
+
+// send buffered tokens
+int lflush (Lexer *l) {
+	l->buf->src = l->str;
+	if (l->cast != NULL ? bpush(l->cast, l->buf) : mpush(l->tok, l->buf)){return 1;}
+	l->buf = taketokbuf(l->spare, l->trivia);
+	if (l->buf == NULL){gperr(); return 1;}
+	return 0;
+}
+
+// error emit, once LexErrMax are reported one more
+// says so & the rest are dropped.
 int lerr (Lexer *l, char *str) {
-	Token tok = {.type = itemErr, .line = l->lineNum, .ch = l->b, .str = str};
-	return pushtok(l->tok, &tok);
+	l->errors++;
+	if (l->errors > LexErrMax + 1){l->tb = l->e; return 0;}
+	if (l->errors > LexErrMax){str = "too many errors, no more are reported";}
+	uint32_t len = l->e - l->b;
+	if (len > TokLenMax){len = TokLenMax;}
+	if (pushtok(l->buf, itemErr, l->b, len)){return 1;}
+	if (pushtokerr(l->buf, str)){l->buf->len--; return 1;} // a token without its message
+	pushtriv(l->buf, l->b - l->tb);
+	l->tb = l->e; // the error's text is not trivia of the next token
+	if (tokbuffull(l->buf)){return lflush(l);}
+	return 0;
 }
 
 // dump characters
@@ -42,45 +79,74 @@ void ldump (Lexer *l) {
 	l->b = l->e;
 }
 
-// emit to token stack
-int lemit (Lexer *l, int n) {
-	// create Token
-	char *str = malloc(100 * sizeof (char));
-	strlcpy(str, &l->str[l->b], (l->e - l->b) + 1);
-	Token tok = {.type = n, .line = l->lineNum, .ch = l->b, .str = str};
-	l->b = l->e;
-	return pushtok(l->tok, &tok);
+// emit to token stack, op is the builtin id of the token
+int lemitop (Lexer *l, int n, int op) {
+	uint32_t len = l->e - l->b;
+	if (len > TokLenMax){
+		int err = lerr(l, "token too long");
+		ldump(l);
+		return err;
+	}
+	if (pushtok(l->buf, n, l->b, len)){return 1;}
+	pushop(l->buf, op);
+	pushtriv(l->buf, l->b - l->tb);
+	l->b = l->e; l->tb = l->b;
+	if (tokbuffull(l->buf)){return lflush(l);}
+	return 0;
 }
 
+int lemit (Lexer *l, int n) {return lemitop(l, n, opNone);}
+
 // lreset resets the lexer to the zeroth index
 void lreset (Lexer *l) {
 	l->e = 0; l->b = 0; // resets storage of characters
 }
 
 // Next & Backup
-// next gets the next character from the file stream in l.
-// backup puts the last character back into the file stream
-// and goes back one character in the char array.
-
-// next character
-char lnext (Lexer *l) {
-	if (l->e >= l->length){
-		l->str = realloc(l->str, (l->e + 10) * sizeof (char));
+// next gets the next character from the char array, filling it
+// a block of input at a time.
+// backup goes back one character in the char array, it is read
+// again by next.
+// Lines are not counted here, they are found from token offsets
+// when they are needed.
+
+// grow str, the old str is retired rather than freed
+// because tokens already sent may still slice it.
+int lgrow (Lexer *l) {
+	char *str = gmalloc(l->length * 2 * sizeof (char));
+	if (str == NULL){gperr(); return 1;}
+	memcpy(str, l->str, l->n);
+	if (push(l->old, l->str)){gfree(str); return 1;}
+	l->str = str;
+	l->length *= 2;
+	return 0;
+}
+
+// copies the next block of input into str
+int lfill (Lexer *l) {
+	if (l->in == NULL || cancelled(l->cancel)){return 1;} // lexing a buffer, all of it is in str
+	char *blk;
+	long n = inext(l->in, &blk);
+	if (n < 0){gerr("could not read input"); return 1;}
+	if (n == 0){return 1;} // end of input
+	while (l->n + n > l->length){
+		if (lgrow(l)){return 1;}
 	}
-	char c;
-	if ((c = getc(l->stream)) != EOF){
-		l->str[l->e] = c;
-		if (c == '\n'){l->lineNum++;} // update line num
-	} else {return EOF;} // deferr error handling.
-	l->e++;
-	return c; // returns char
+	memcpy(&l->str[l->n], blk, n);
+	l->n += n;
+	return 0;
+}
+
+// next character as an unsigned char, so no byte is taken for EOF
+int lnext (Lexer *l) {
+	if (l->e >= l->n && lfill(l)){return EOF;}
+	return (unsigned char) l->str[l->e++];
 }
 
 // backup one character
 int lbackup (Lexer *l) {
 	if ((l->e - l->b) > 0){
 		l->e--;
-		ungetc(l->str[l->e], l->stream);
 		return 0;
 	}
 	return 1; // should never reach
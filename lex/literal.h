@@ -0,0 +1,142 @@
+#import <stdint.h> // uint32_t
+#import <string.h> // memchr
+#if defined(__AVX2__)
+#import <immintrin.h> // _mm256_cmpeq_epi8
+#elif defined(__SSE2__)
+#import <emmintrin.h> // _mm_cmpeq_epi8
+#endif
+
+// Literals
+// strings & chars are scanned for their closing quote 32 bytes at a
+// time: blocks with no quote, backslash or byte over 0x7f are passed
+// whole, so plain text scans at close to memchr speed, and escapes &
+// UTF-8 are only checked a byte at a time where a block has them.
+// The lexer never copies a literal, its token slices the source;
+// litstr decodes the escapes of one when asked, handing back the
+// source itself when it has none.
+// Escapes are \n \t \r \0 \\ \" \' & \x with two hex digits.
+
+// Include guard.
+#ifndef LITERAL
+#define LITERAL
+
+// flags of a scan
+const int litClosed = 1; // the closing quote was found
+const int litEscaped = 2; // a backslash was found
+const int litBadUtf8 = 4;
+const int litBadEscape = 8;
+
+// offset of the next q, backslash or byte over 0x7f at or after i, or n
+uint32_t _litnext (const char *s, uint32_t i, uint32_t n, char q) {
+#if defined(__AVX2__)
+	const __m256i quote = _mm256_set1_epi8(q);
+	const __m256i slash = _mm256_set1_epi8('\\');
+	for (; i + 32 <= n; i += 32){
+		__m256i v = _mm256_loadu_si256((const __m256i *) &s[i]);
+		__m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash));
+		uint32_t bits = _mm256_movemask_epi8(_mm256_or_si256(m, v)); // high bit set
+		if (bits){return i + __builtin_ctz(bits);}
+	}
+#elif defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8(q);
+	const __m128i slash = _mm_set1_epi8('\\');
+	for (; i + 32 <= n; i += 32){
+		__m128i v = _mm_loadu_si128((const __m128i *) &s[i]);
+		__m128i w = _mm_loadu_si128((const __m128i *) &s[i + 16]);
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash));
+		__m128i k = _mm_or_si128(_mm_cmpeq_epi8(w, quote), _mm_cmpeq_epi8(w, slash));
+		uint32_t bits = _mm_movemask_epi8(_mm_or_si128(m, v)) | _mm_movemask_epi8(_mm_or_si128(k, w)) << 16;
+		if (bits){return i + __builtin_ctz(bits);}
+	}
+#endif
+	for (; i < n; i++){
+		char c = s[i];
+		if (c == q || c == '\\' || (unsigned char) c > 0x7f){return i;}
+	}
+	return n;
+}
+
+int _ishex (char c) {return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');}
+
+int _hexval (char c) {return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;}
+
+// length of the escape at s, of n bytes: 0 if it is invalid,
+// -1 if it runs past n.
+int _esclen (const char *s, uint32_t n) {
+	if (n < 2){return -1;}
+	char c = s[1];
+	if (c == 'x'){
+		if (n < 4){return -1;}
+		return _ishex(s[2]) && _ishex(s[3]) ? 4 : 0;
+	}
+	return c != '\0' && strchr("nrt0\\\"'", c) != NULL ? 2 : 0;
+}
+
+// length of the UTF-8 sequence at s, of n bytes: 0 if it is invalid,
+// -1 if it runs past n. Overlong forms & surrogates are invalid.
+int _utf8len (const unsigned char *s, uint32_t n) {
+	unsigned char c = s[0];
+	int len;
+	if (c < 0x80){return 1;}
+	else if (c >= 0xc2 && c <= 0xdf){len = 2;}
+	else if (c >= 0xe0 && c <= 0xef){len = 3;}
+	else if (c >= 0xf0 && c <= 0xf4){len = 4;}
+	else{return 0;}
+	for (int i = 1; i < len; i++){
+		if ((uint32_t) i >= n){return -1;}
+		if ((s[i] & 0xc0) != 0x80){return 0;}
+	}
+	if ((c == 0xe0 && s[1] < 0xa0) || (c == 0xed && s[1] > 0x9f)){return 0;}
+	if ((c == 0xf0 && s[1] < 0x90) || (c == 0xf4 && s[1] > 0x8f)){return 0;}
+	return len;
+}
+
+// scans a literal from i, past its opening q, to its closing q in
+// the n bytes of s, adding what it finds to flags. Returns the offset
+// of the closing q; or if there is none, where to scan on from once
+// s has more, which is short of n if an escape or UTF-8 sequence is
+// cut off at n.
+uint32_t litscan (const char *s, uint32_t i, uint32_t n, char q, int *flags) {
+	while ((i = _litnext(s, i, n, q)) < n){
+		if (s[i] == q){*flags |= litClosed; return i;}
+		int len;
+		if (s[i] == '\\'){
+			*flags |= litEscaped;
+			if ((len = _esclen(&s[i], n - i)) < 0){return i;}
+			if (len == 0){*flags |= litBadEscape; len = 1;} // the next byte is read as it is
+		} else {
+			if ((len = _utf8len((const unsigned char *) &s[i], n - i)) < 0){return i;}
+			if (len == 0){*flags |= litBadUtf8; len = 1;}
+		}
+		i += len;
+	}
+	return n;
+}
+
+// text of the literal s, len bytes with its quotes, of length *n:
+// the source itself if it has no escapes, otherwise decoded into
+// buf, which must hold len bytes.
+const char *litstr (const char *s, uint32_t len, char *buf, uint32_t *n) {
+	s++; len = len >= 2 ? len - 2 : 0; // quotes
+	const char *e = memchr(s, '\\', len);
+	if (e == NULL){*n = len; return s;}
+	uint32_t i = e - s, j = i;
+	memcpy(buf, s, i);
+	while (i < len){
+		if (s[i] != '\\'){buf[j++] = s[i++]; continue;}
+		int k = _esclen(&s[i], len - i);
+		if (k <= 0){buf[j++] = s[i++]; continue;} // invalid, kept as it is
+		char c = s[i + 1];
+		if (c == 'x'){c = _hexval(s[i + 2]) << 4 | _hexval(s[i + 3]);}
+		else if (c == 'n'){c = '\n';}
+		else if (c == 't'){c = '\t';}
+		else if (c == 'r'){c = '\r';}
+		else if (c == '0'){c = '\0';}
+		buf[j++] = c;
+		i += k;
+	}
+	*n = j;
+	return buf;
+}
+
+#endif // LITERAL
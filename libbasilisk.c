@@ -0,0 +1,215 @@
+#import <stdlib.h> // calloc
+#import <limits.h> // INT_MAX
+#import <pthread.h>
+#import "libbasilisk.h" // public interface
+
+#import "context.h" // contexts
+#import "parse/outline.h" // outlines
+#import "emit/emit.h" // emit
+
+// libbasilisk, built from the same headers as basilisk. Built with
+// -fvisibility=hidden only the basilisk_ functions are exported:
+//
+//	cc -shared -fPIC -fvisibility=hidden libbasilisk.c -o libbasilisk.so -lpthread -lz
+
+#define export __attribute__((visibility("default")))
+
+struct basilisk {
+	Basilisk b;
+	Outline *outline; // outline of the last source, or NULL
+	pthread_mutex_t lock; // calls take turns, recursive so visitors may call back
+	int walking; // walks in progress, whose trees must outlive them
+};
+
+// drops the last tree or outline, the lock is held
+void _basilisk_reset (basilisk *ctx) {
+	if (ctx->outline != NULL){freeoutline(ctx->outline); ctx->outline = NULL;}
+	resetcontext(&ctx->b);
+}
+
+export basilisk *basilisk_new (const basilisk_options *opt) {
+	basilisk *ctx = calloc(1, sizeof (basilisk));
+	if (ctx == NULL){return NULL;}
+	if (opt != NULL){
+		ctx->b.trivia = opt->trivia;
+		ctx->b.cons = opt->cons;
+		ctx->b.errstream = opt->errstream;
+		ctx->b.timeout = opt->timeout;
+	}
+	if (initcontext(&ctx->b)){free(ctx); return NULL;}
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&ctx->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	return ctx;
+}
+
+export void basilisk_free (basilisk *ctx) {
+	if (ctx == NULL){return;}
+	_basilisk_reset(ctx);
+	freecontext(&ctx->b);
+	pthread_mutex_destroy(&ctx->lock);
+	free(ctx);
+}
+
+// parses b's buf or stream, the lock is held
+int _basilisk_parse (basilisk *ctx) {
+	if (runcontext(&ctx->b) || ctx->b.root == NULL){return -1;}
+	return ctx->b.errors;
+}
+
+export int basilisk_parse_buffer (basilisk *ctx, const char *name, const char *buf, size_t len) {
+	if (len > INT_MAX){return -1;} // offsets are ints
+	pthread_mutex_lock(&ctx->lock);
+	if (ctx->walking){pthread_mutex_unlock(&ctx->lock); return -1;}
+	_basilisk_reset(ctx);
+	ctx->b.name = (char *) name;
+	ctx->b.buf = (char *) buf; // only read
+	ctx->b.buflen = len;
+	ctx->b.stream = NULL;
+	int n = _basilisk_parse(ctx);
+	pthread_mutex_unlock(&ctx->lock);
+	return n;
+}
+
+export int basilisk_parse_file (basilisk *ctx, const char *path) {
+	FILE *f = fopen(path, "r");
+	if (f == NULL){return -1;}
+	pthread_mutex_lock(&ctx->lock);
+	if (ctx->walking){pthread_mutex_unlock(&ctx->lock); fclose(f); return -1;}
+	_basilisk_reset(ctx);
+	if (ctx->b.in == NULL){ctx->b.in = initinput();}
+	int n = -1;
+	if (ctx->b.in != NULL){
+		ctx->b.name = (char *) path;
+		ctx->b.buf = NULL;
+		ctx->b.stream = f;
+		n = _basilisk_parse(ctx);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+	fclose(f);
+	return n;
+}
+
+export int basilisk_outline_buffer (basilisk *ctx, const char *name, const char *buf, size_t len) {
+	if (len > INT_MAX){return -1;}
+	pthread_mutex_lock(&ctx->lock);
+	if (ctx->walking){pthread_mutex_unlock(&ctx->lock); return -1;}
+	_basilisk_reset(ctx);
+	ctx->b.name = (char *) name;
+	ctx->outline = initoutline(&ctx->b, (char *) buf, len);
+	int n = ctx->outline != NULL ? ctx->outline->nform : -1;
+	pthread_mutex_unlock(&ctx->lock);
+	return n;
+}
+
+export int basilisk_get_form (basilisk *ctx, int i, basilisk_form *form) {
+	pthread_mutex_lock(&ctx->lock);
+	Outline *o = ctx->outline;
+	int err = o == NULL || i < 0 || i >= o->nform;
+	if (!err){
+		Form *f = &o->form[i];
+		form->off = f->off;
+		form->len = f->len;
+		form->head = f->head > 0 ? &o->src[f->off + 1] : NULL;
+		form->headlen = f->head;
+		form->builtin = f->op;
+	}
+	pthread_mutex_unlock(&ctx->lock);
+	return err;
+}
+
+export void basilisk_reset (basilisk *ctx) {
+	pthread_mutex_lock(&ctx->lock);
+	if (!ctx->walking){_basilisk_reset(ctx);}
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+typedef struct {
+	basilisk_visit visit;
+	void *v;
+	char *text;
+} _basilisk_walker;
+
+int _basilisk_walk (AsTree *tree, int depth, int exit, void *v) {
+	_basilisk_walker *w = v;
+	if (depth == 0){return 0;} // the root is not a node
+	basilisk_node n = {.kind = BASILISK_LIST, .children = tree->len, .id = tree->id};
+	if (tree->trivlen > 0){n.trivia = &w->text[tree->triv]; n.trivialen = tree->trivlen;}
+	if (tree->node != NULL){
+		Node *nd = tree->node;
+		if (nd->type == itemNum){n.kind = BASILISK_NUM;}
+		else if (nd->type == itemChar){n.kind = BASILISK_CHAR;}
+		else if (nd->type == itemStr){n.kind = BASILISK_STR;}
+		n.builtin = nd->op;
+		n.text = &w->text[nd->off];
+		n.len = nd->len;
+	}
+	return w->visit(&n, depth - 1, exit, w->v);
+}
+
+export int basilisk_walk (basilisk *ctx, basilisk_visit visit, void *v) {
+	pthread_mutex_lock(&ctx->lock);
+	_basilisk_walker w = {.visit = visit, .v = v, .text = ctx->b.text};
+	ctx->walking++;
+	int err = walkast(ctx->b.root, _basilisk_walk, &w);
+	ctx->walking--;
+	pthread_mutex_unlock(&ctx->lock);
+	return err;
+}
+
+export int basilisk_emit (basilisk *ctx, int fd, int width) {
+	pthread_mutex_lock(&ctx->lock);
+	Emitter *e = initemit(fd, width);
+	int err = e == NULL || emit(e, ctx->b.root, ctx->b.text, ctx->b.textlen);
+	if (e != NULL){freeemit(e);}
+	pthread_mutex_unlock(&ctx->lock);
+	return err;
+}
+
+export const char *basilisk_literal (const basilisk_node *node, char *buf, size_t *len) {
+	uint32_t n;
+	const char *s = litstr(node->text, node->len, buf, &n);
+	*len = n;
+	return s;
+}
+
+// not under the lock, which the parse holds
+export void basilisk_cancel (basilisk *ctx) {cancel(ctx->b.cancel);}
+
+export int basilisk_cancelled (basilisk *ctx) {
+	pthread_mutex_lock(&ctx->lock);
+	int c = ctx->b.cancelled;
+	pthread_mutex_unlock(&ctx->lock);
+	return c;
+}
+
+export int basilisk_errors (basilisk *ctx) {
+	pthread_mutex_lock(&ctx->lock);
+	int n = ctx->b.errors;
+	pthread_mutex_unlock(&ctx->lock);
+	return n;
+}
+
+export int basilisk_warnings (basilisk *ctx) {
+	pthread_mutex_lock(&ctx->lock);
+	int n = ctx->b.warns;
+	pthread_mutex_unlock(&ctx->lock);
+	return n;
+}
+
+export int basilisk_walk_form (basilisk *ctx, int i, basilisk_visit visit, void *v) {
+	pthread_mutex_lock(&ctx->lock);
+	Outline *o = ctx->outline;
+	int err = 1;
+	if (o != NULL && i >= 0 && i < o->nform){
+		_basilisk_walker w = {.visit = visit, .v = v, .text = o->src};
+		AsTree *tree = outlinetree(o, i); // earlier forms' trees are kept
+		ctx->walking++;
+		err = tree == NULL || walkast(tree, _basilisk_walk, &w);
+		ctx->walking--;
+	}
+	pthread_mutex_unlock(&ctx->lock);
+	return err;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h> // FILE
+#include <stddef.h> // size_t
+
+// libbasilisk
+// parses Basilisk source in a program. A basilisk context parses one
+// source at a time, keeping the tree until the next parse or reset;
+// the buffers it grows are kept too, so parsing again does not
+// allocate once they fit.
+// Calls on a context take turns, any thread may make them. Separate
+// contexts parse in parallel. A visitor may call back into the context
+// it walks, but not to parse or reset it: those fail, or do nothing,
+// until the walk is over.
+//
+//	basilisk *ctx = basilisk_new(NULL);
+//	int errors = basilisk_parse_buffer(ctx, "main.lsp", src, len);
+//	basilisk_walk(ctx, visit, v);
+//	basilisk_free(ctx);
+
+// Include guard.
+#ifndef LIBBASILISK
+#define LIBBASILISK
+
+typedef struct basilisk basilisk;
+
+typedef struct {
+	int trivia; // keep whitespace & comments before tokens
+	int cons; // share identical subtrees
+	FILE *errstream; // where diagnostics are written, NULL to only count them
+	double timeout; // seconds before a parse is cancelled, 0 for never
+} basilisk_options;
+
+// kinds of node
+enum {
+	BASILISK_LIST = 1, // text is the list's operator, if it has one
+	BASILISK_NUM,
+	BASILISK_CHAR,
+	BASILISK_STR
+};
+
+typedef struct {
+	int kind;
+	int builtin; // id of a builtin operator, see tok/ops, 0 for none
+	const char *text; // slice of the source, not terminated
+	size_t len;
+	int children;
+	int id; // unique subtree id when sharing subtrees, otherwise 0
+	const char *trivia; // whitespace & comments before it, or before a list's (, when kept, not terminated
+	size_t trivialen; // 0 when there are none or trivia is not kept
+} basilisk_node;
+
+// a top-level form of an outline
+typedef struct {
+	size_t off; // span of the form in the source
+	size_t len;
+	const char *head; // its operator, not terminated, NULL for none
+	size_t headlen;
+	int builtin; // id of a builtin operator, 0 for none
+} basilisk_form;
+
+// called entering each node & again leaving it, with exit set.
+// A nonzero return stops the walk.
+typedef int (*basilisk_visit) (const basilisk_node *node, int depth, int exit, void *v);
+
+// a new context, opt may be NULL for the defaults
+basilisk *basilisk_new (const basilisk_options *opt);
+void basilisk_free (basilisk *ctx);
+
+// parse len bytes of buf, which the tree slices so it must outlive
+// the parse. Returns the number of errors, or -1 if parsing failed.
+int basilisk_parse_buffer (basilisk *ctx, const char *name, const char *buf, size_t len);
+
+// parse the file at path, gzip & zstd are decompressed.
+// Returns the number of errors, or -1 if parsing failed.
+int basilisk_parse_file (basilisk *ctx, const char *path);
+
+// outlines len bytes of buf: finds its top-level forms by matching
+// parens, without parsing them. Each form is parsed the first time
+// it is walked. Returns the number of forms, or -1.
+int basilisk_outline_buffer (basilisk *ctx, const char *name, const char *buf, size_t len);
+
+// form i of the last outline, returns nonzero if there is none
+int basilisk_get_form (basilisk *ctx, int i, basilisk_form *form);
+
+// walks form i of the last outline, parsing it if it has not been
+int basilisk_walk_form (basilisk *ctx, int i, basilisk_visit visit, void *v);
+
+// drops the last tree, keeping its memory for the next parse
+void basilisk_reset (basilisk *ctx);
+
+// walks the tree of the last parse in source order, see visitors above
+int basilisk_walk (basilisk *ctx, basilisk_visit visit, void *v);
+
+// writes the tree of the last parse back out as source to fd, breaking
+// lists wider than width columns, or never if width is 0
+int basilisk_emit (basilisk *ctx, int fd, int width);
+
+// text of a BASILISK_STR or BASILISK_CHAR node without its quotes,
+// of length *len: a slice of the source unless it has escapes, which
+// are decoded into buf, of at least node->len bytes
+const char *basilisk_literal (const basilisk_node *node, char *buf, size_t *len);
+
+// cancels the parse running on ctx, from any thread: it returns at
+// once with the tree parsed so far. A parse begun after is not cancelled.
+void basilisk_cancel (basilisk *ctx);
+
+// was the last parse cancelled, by basilisk_cancel or its timeout?
+int basilisk_cancelled (basilisk *ctx);
+
+int basilisk_errors (basilisk *ctx);
+int basilisk_warnings (basilisk *ctx);
+
+#endif // LIBBASILISK
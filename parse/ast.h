@@ -1,72 +1,189 @@
+#import <stdint.h> // uint32_t
+#import <stdlib.h> // malloc
+#import "../util/stack.h" // Stack
+#import "../util/govern.h" // gsmalloc
+
 // Abstract Syntax Tree
 
 typedef struct {
-	int type;
-	int line;
-	int ch;
+	int16_t type;
+	uint16_t op; // builtin id of an itemOp, opNone otherwise
+	uint32_t off; // offset of text in source
+	uint32_t len; // length of text
 } Node;
 
 Node *_copynode (Node *node) {
 	if (node == NULL){return NULL;}
 
 	// Create new error
-	Node *nd = malloc(sizeof (Node)); // allocate on heap.
-	if (nd == NULL){free(nd); return NULL;} // token check.
+	Node *nd = gsmalloc(memAst, sizeof (Node)); // allocate on heap.
+	if (nd == NULL){return NULL;} // token check.
 
 	// copy ints from value
 	nd->type = node->type;
-	nd->line = node->line;
-	nd->ch = node->ch;
+	nd->op = node->op;
+	nd->off = node->off;
+	nd->len = node->len;
 
 	return nd;
 }
 
+// AsTree
+// a list has its operator as node and its arguments as tree,
+// an atom has only a node, the root has only a tree.
 typedef struct {
 	Node *node;
 	void **tree; // AsTree stack (void to avoid recursive definition)
 	int len;
 	int max;
+	int id; // unique subtree id when hash-consed, otherwise 0
+	uint32_t span; // length of a list's source from its (, if it is laid out as emit writes it, otherwise 0
+	uint32_t triv; // offset of the whitespace & comments before it, or its (, kept with trivia
+	uint32_t trivlen;
 } AsTree;
 
 const int AstStackBuf = 5;
 
+// create a tree on the heap, node may go out of scope.
+AsTree *initast (Node *node) {
+	AsTree *tree = gsmalloc(memAst, sizeof (AsTree));
+	if (tree == NULL){return NULL;}
+
+	tree->node = NULL;
+	if (node != NULL){
+		tree->node = _copynode(node);
+		if (tree->node == NULL){gfree(tree); return NULL;}
+	}
+	tree->tree = NULL;
+	tree->len = 0;
+	tree->max = 0;
+	tree->id = 0;
+	tree->span = 0;
+	tree->triv = 0;
+	tree->trivlen = 0;
+	return tree;
+}
+
+// Walking
+// trees are walked with an explicit stack on the heap rather than
+// recursion, so a tree can be as deep as memory allows.
+// visit is called entering each tree and again leaving it, after
+// all its subtrees, with exit set. A nonzero return stops the walk.
+// Shared (hash consed) subtrees are visited once per parent.
+
+typedef int (*astFun) (AsTree *tree, int depth, int exit, void *v);
+
+typedef struct {
+	AsTree *tree;
+	int i; // next subtree to enter
+} AstFrame;
+
+int walkast (AsTree *tree, astFun visit, void *v) {
+	if (tree == NULL){return 0;}
+	int len = 0, max = AstStackBuf;
+	AstFrame *st = gmalloc(max * sizeof (AstFrame));
+	if (st == NULL){return 1;}
+	int err = visit(tree, 0, 0, v);
+	AstFrame root = {.tree = tree, .i = 0};
+	st[len++] = root;
+	while (len > 0 && !err){
+		AstFrame *f = &st[len - 1];
+		if (f->i >= f->tree->len){
+			err = visit(f->tree, len - 1, 1, v);
+			len--;
+			continue;
+		}
+		AsTree *sub = f->tree->tree[f->i++];
+		if (len >= max){
+			AstFrame *s = grealloc(st, max * 2 * sizeof (AstFrame));
+			if (s == NULL){gfree(st); return 1;}
+			st = s; max *= 2;
+		}
+		err = visit(sub, len, 0, v);
+		AstFrame next = {.tree = sub, .i = 0};
+		st[len++] = next;
+	}
+	gfree(st);
+	return err;
+}
+
+// frees a tree on leaving it, its subtrees are already freed
+int _freeast (AsTree *tree, int depth, int exit, void *v) {
+	(void) depth; (void) v;
+	if (exit){
+		gfree(tree->tree);
+		gfree(tree->node);
+		gfree(tree);
+	}
+	return 0;
+}
+
+// frees a tree and all of its subtrees,
+// which must not be shared.
+void freeast (AsTree *tree) {
+	walkast(tree, _freeast, NULL);
+}
+
 // create a lasting error, given an error where elements
 // will go out of scope.
+// Copies are made a level at a time: each tree on the stack is
+// paired with its copy, whose subtrees are filled in when it is
+// popped.
 AsTree *_copyast (AsTree *ast) {
 	if (ast == NULL){return NULL;}
 
 	// Create new error
-	AsTree *tree = malloc(sizeof (AsTree)); // allocate on heap.
-	if (tree == NULL){free(tree); return NULL;} // token check.
+	AsTree *tree = initast(ast->node); // allocate on heap.
+	if (tree == NULL){return NULL;} // token check.
+	Stack *st = initstack();
+	if (st == NULL || push(st, ast) || push(st, tree)){freeast(tree); return NULL;}
 
-	tree->node = _copynode(ast->node); // copy node
-	for (int i = 0; i < ast->len; i++){
-		tree->tree[i] = _copyast(ast->tree[i]); // recursive copy
+	AsTree *src, *dst;
+	int err = 0;
+	while (!err && (dst = pop(st)) != NULL){
+		src = pop(st);
+		dst->id = src->id;
+		dst->span = src->span;
+		dst->triv = src->triv;
+		dst->trivlen = src->trivlen;
+		if (src->len == 0){continue;}
+		dst->tree = gsmalloc(memAst, src->len * sizeof (AsTree *));
+		if (dst->tree == NULL){err = 1; break;}
+		dst->max = src->len;
+		while (!err && dst->len < src->len){
+			AsTree *sub = initast(((AsTree *) src->tree[dst->len])->node);
+			if (sub == NULL){err = 1; break;}
+			dst->tree[dst->len] = sub;
+			err = push(st, src->tree[dst->len]) || push(st, sub);
+			dst->len++;
+		}
 	}
-	tree->len = ast->len;
 
+	// stopped early, out of memory
+	if (err){freestack(st); freeast(tree); return NULL;}
+	freestack(st);
 	return tree;
 }
 
 int resizeast (AsTree *tree) {
 	int grow, shrink;
 	grow = tree == NULL || tree->len >= tree->max;
-	shrink = tree->max - tree->len > AstStackBuf;
+	shrink = tree->max > AstStackBuf && tree->len < tree->max / 4;
 	if (!grow && !shrink) {return 0;}
-	
-	// reallocate len+buf # of Error pointer positions
-	int buff;
-	if (grow){buff = AstStackBuf;}
-	else{buff = 0;}
-	size_t size = (tree->len + buff) * sizeof (AsTree *);
-	tree->tree = (void **) realloc(tree->tree, size);
-	if (tree->tree == NULL){free(tree->tree); return 1;}
-	tree->max = size / sizeof (AsTree *); // new max is len
+
+	// grows & shrinks geometrically, like resizestack
+	int max;
+	if (grow){max = tree->max > 0 ? tree->max * 2 : AstStackBuf;}
+	else{max = tree->max / 2;}
+	void **v = (void **) gsrealloc(memAst, tree->tree, max * sizeof (AsTree *));
+	if (v == NULL){return 1;}
+	tree->tree = v;
+	tree->max = max;
 	return 0;
 }
 
 // pops error from an error stack
-Token *popast (AsTree *tree) {
+AsTree *popast (AsTree *tree) {
 	if (tree->len <= 0){return NULL;} // double check.
 
 	// resize stack
@@ -78,22 +195,19 @@ Token *popast (AsTree *tree) {
 	return tree->tree[tree->len]; // pass reference to Error
 }
 
-// pushes error onto an error stack
+// pushes a subtree onto a tree,
+// tr must be heap memory, tree now owns it.
 int pushast (AsTree *tree, AsTree *tr) {
+	if (tr == NULL) {return 1;}
 
 	// resize stack
-	if(resizeast(tree)){return 1;}
+	if(tree->len >= tree->max && resizeast(tree)){return 1;} // only grows, pops shrink
 
 	tree->len++; // increment len
 	if (tree->len <= 0){return 1;}
 
-	// move error to heap memory
-	AsTree *trc = _copyast(tr);
-	if (trc == NULL) {return 1;}
-
 	// Push to created space on stack
-	// err is an array of *Error, error is an *Error
-	tree->tree[tree->len - 1] = trc; // err must be heap memory.
+	tree->tree[tree->len - 1] = tr;
 	return 0;
 }
 
@@ -101,4 +215,112 @@ int pushast (AsTree *tree, AsTree *tr) {
 int resetast (AsTree *tree) {
 	tree->len = 0; // zero errors in stack
 	return 0;
-}
\ No newline at end of file
+}
+
+// Pooling
+// trees & nodes that are done with can be kept in a pool, with
+// the capacity of their subtree arrays, and taken again instead of
+// allocated. A NULL pool allocates & frees.
+typedef struct {
+	Stack *tree; // spare trees with room for subtrees
+	Stack *atom; // spare trees without
+	Stack *node; // spare nodes
+} AstPool;
+
+AstPool *initastpool () {
+	AstPool *pool = gsmalloc(memAst, sizeof (AstPool));
+	if (pool == NULL){return NULL;}
+	pool->tree = initstack();
+	pool->atom = initstack();
+	pool->node = initstack();
+	if (pool->tree == NULL || pool->atom == NULL || pool->node == NULL){return NULL;}
+	pool->tree->keep = 1;
+	pool->atom->keep = 1;
+	pool->node->keep = 1;
+	return pool;
+}
+
+int freeastpool (AstPool *pool) {
+	void *v;
+	while ((v = pop(pool->tree)) != NULL){freeast(v);}
+	while ((v = pop(pool->atom)) != NULL){freeast(v);}
+	while ((v = pop(pool->node)) != NULL){gfree(v);}
+	freestack(pool->tree);
+	freestack(pool->atom);
+	freestack(pool->node);
+	gfree(pool);
+	return 0;
+}
+
+// like _copynode, from pool
+Node *poolnode (AstPool *pool, Node *node) {
+	Node *nd = pool != NULL ? pop(pool->node) : NULL;
+	if (nd == NULL){return _copynode(node);}
+	*nd = *node;
+	return nd;
+}
+
+// returns one tree to pool, not its subtrees
+void _poolone (AstPool *pool, AsTree *tree) {
+	if (pool == NULL || push(tree->max > 0 ? pool->tree : pool->atom, tree)){
+		gfree(tree->tree); gfree(tree->node); gfree(tree);
+		return;
+	}
+	if (tree->node != NULL && push(pool->node, tree->node)){gfree(tree->node);}
+	tree->node = NULL;
+	tree->len = 0;
+	tree->id = 0;
+	tree->span = 0;
+	tree->trivlen = 0;
+}
+
+// like initast, from pool. Lists, without a node until their
+// operator is read, get a tree with room for subtrees.
+AsTree *poolast (AstPool *pool, Node *node) {
+	if (pool == NULL){return initast(node);}
+	Stack *first = node == NULL ? pool->tree : pool->atom;
+	Stack *then = node == NULL ? pool->atom : pool->tree;
+	AsTree *tree = pop(first);
+	if (tree == NULL){tree = pop(then);}
+	if (tree == NULL){return initast(node);}
+	if (node != NULL && (tree->node = poolnode(pool, node)) == NULL){
+		_poolone(pool, tree);
+		return NULL;
+	}
+	return tree;
+}
+
+// like freeast, returning tree & its subtrees to pool.
+// The pool's tree stack is the work list: each tree is pushed,
+// then its subtrees are pushed after it before it is emptied.
+// Atoms are moved to their own stack after.
+void recycleast (AstPool *pool, AsTree *tree) {
+	if (pool == NULL){freeast(tree); return;}
+	Stack *st = pool->tree;
+	int i, start = st->len;
+	if (push(st, tree)){freeast(tree); return;}
+	for (i = start; i < st->len; i++){
+		AsTree *t = st->stack[i];
+		for (int j = 0; j < t->len; j++){
+			if (push(st, t->tree[j])){freeast(t->tree[j]);}
+		}
+		if (t->node != NULL && push(pool->node, t->node)){gfree(t->node);}
+		t->node = NULL;
+		t->len = 0;
+		t->id = 0;
+		t->span = 0;
+		t->trivlen = 0;
+	}
+	int j = start;
+	for (i = start; i < st->len; i++){
+		AsTree *t = st->stack[i];
+		if (t->max == 0 && !push(pool->atom, t)){continue;}
+		st->stack[j++] = t;
+	}
+	st->len = j;
+	// tree is taken first next time, keep its room for it
+	if (j > start + 1 && st->stack[start] == tree){
+		st->stack[start] = st->stack[j - 1];
+		st->stack[j - 1] = tree;
+	}
+}
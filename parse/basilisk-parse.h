@@ -1,6 +1,8 @@
 #import <stdlib.h> // calloc, exit, etc.
 #import "../tok/tok.h" // token header
 #import "ast.h" // abstract syntax tree
+#import "cons.h" // hash consing
+#import "check.h" // semantic checks
 #import "parse.h" // generic parse header
 #import "../util/state.h" // state machine
 #import "../basilisk.h" // Basilisk type
@@ -15,26 +17,139 @@ const int parsenAll = 0;
 const int parsenList = 1;
 const int parsenOp = 2;
 
+// next token, reads a new token buffer when the last is used up,
+// NULL at the end or once cancelled.
 Token *pnext(Parser *p) {
-	Token *t = mnext(p->tok);
-	if (t->type == itemEOF){return NULL;}
-	else if (t->type == itemErr){perr(p, t, t->str, 0); p->errors++;}
+	if (p->back){p->back = 0; return &p->cur;}
+	if (p->buf == NULL || p->i >= p->buf->len){
+		if (p->cast != NULL){p->buf = bnext(p->cast, p->sub);} // freed by cast
+		else {
+			if (p->buf != NULL){givetokbuf(p->spare, p->buf);}
+			p->buf = mnext(p->tok);
+		}
+		if (p->buf == NULL){return NULL;} // cancelled
+		p->src = p->buf->src; // later bufs slice all of earlier srcs
+		p->i = 0; p->erri = 0;
+	}
+	p->cur = tokat(p->buf, p->i++);
+	Token *t = &p->cur;
+	if (toktype(t) == itemEOF){return NULL;}
+	else if (toktype(t) == itemErr){perr(p, t, p->buf->errors->stack[p->erri++], 0);}
 	return t;
 }
 
+// backup one token
+void pbackup(Parser *p) {p->back = 1;}
+
+// Tree building
+// lists are pushed onto the tree when they begin, and become
+// the tree being built until they end.
+// When hash consing, atoms & ended lists are swapped for their
+// shared copies.
+
+// Layout
+// while a list is built its span is nonzero for as long as its source
+// is laid out as emit would write it: the operator right after the (,
+// then each element after one space, then the ). Ended lists get the
+// length of that source, so it can be written back as it is.
+
+// an element of the list being built begins at t
+void playout(Parser *p, Token *t) {
+	if (p->tree->span && (t->off != p->last + 1 || p->src[p->last] != ' ')){p->tree->span = 0;}
+	p->last = t->off + toklen(t);
+}
+
+// node of the token last read
+Node pnode(Parser *p, Token *t) {
+	Node n = {.type = toktype(t), .op = tokop(p->buf, p->i - 1), .off = t->off, .len = toklen(t)};
+	return n;
+}
+
+// Trivia
+// when the lexer keeps trivia, each tree gets the whitespace &
+// comments before its token, or before the ( of a list. A shared
+// subtree keeps those of where it was first found.
+
+void ptriv(Parser *p, AsTree *tree, Token *t) {
+	if (p->buf->triv == NULL){return;}
+	tree->trivlen = p->buf->triv[p->i - 1];
+	tree->triv = t->off - tree->trivlen;
+}
+
+// begin a list in tree at t
+int plist(Parser *p, Token *t) {
+	playout(p, t);
+	AsTree *tree = poolast(p->pool, NULL);
+	if (tree == NULL){return 1;}
+	ptriv(p, tree, t);
+	if (pushast(p->tree, tree)){return 1;}
+	if (push(p->up, p->tree)){return 1;}
+	p->tree = tree;
+	p->tree->span = 1;
+	return 0;
+}
+
+// end the list being built at t, or NULL if it is unclosed
+int pend(Parser *p, Token *t) {
+	AsTree *up = pop(p->up);
+	if (up == NULL){return 1;}
+	AsTree *tree = p->tree;
+	if (t == NULL || tree->node == NULL || t->off != p->last){tree->span = 0;}
+	else if (tree->span){tree->span = t->off + 1 - (tree->node->off - 1);}
+	if (t != NULL){p->last = t->off + 1;}
+	if (!tree->span){up->span = 0;}
+	if (p->cons != NULL){
+		AsTree *tree = intern(p->cons, p->tree, p->src);
+		if (tree == NULL){return 1;}
+		up->tree[up->len - 1] = tree;
+	}
+	p->tree = up;
+	return 0;
+}
+
+// sends the top-level forms ended since the last to the checker &
+// the wire. A failed write stops the stream, not the parse.
+int psend(Parser *p) {
+	for (; p->sent < p->root->len; p->sent++){
+		AsTree *form = p->root->tree[p->sent];
+		if (p->check != NULL && checkform(p->check, form, p->src)){return 1;}
+		if (p->wire != NULL){wireform(p->wire, form, p->src, p->last);}
+	}
+	return 0;
+}
+
+// add an atom to the list being built
+int patom(Parser *p, Token *t) {
+	playout(p, t);
+	Node n = pnode(p, t);
+	AsTree *tree = poolast(p->pool, &n);
+	if (tree == NULL){return 1;}
+	ptriv(p, tree, t);
+	if (p->cons != NULL && (tree = intern(p->cons, tree, p->src)) == NULL){return 1;}
+	return pushast(p->tree, tree);
+}
+
 // parse for beginning and end to list
 int parseAll(void *v) {
 	Parser *p = (Parser *) v;
 	Token *t;
 	while((t = pnext(p)) != NULL){
-		if (t->type == itemBeginList){
-			p->parenDepth++; return parsenList;
-		} else if (t->type == itemEndList){
+		if (toktype(t) == itemBeginList){
+			p->parenDepth++;
+			if (plist(p, t)){gperr(); return -1;}
+			return parsenList;
+		} else if (toktype(t) == itemEndList){
 			p->parenDepth--;
-			if (p->parenDepth > 0) {return 1;}
-			else if (p->parenDepth < 0) {
+			if (p->parenDepth < 0) {
 				perr(p, t, "too many parens", 0);
 				p->parenDepth++; // avoid further errors
+				return parsenAll;
+			}
+			if (pend(p, t)){gperr(); return -1;}
+			if (p->parenDepth > 0) {return parsenOp;}
+			if ((p->check != NULL || p->wire != NULL) && psend(p)){
+				if (!cancelled(p->cancel)){gperr();}
+				return -1;
 			}
 			return parsenAll;
 		}
@@ -47,8 +162,15 @@ int parseList(void *v) {
 	Parser *p = (Parser *) v;
 	Token *t;
 	while((t = pnext(p)) != NULL){
-		if (t->type == itemOp) {
+		if (toktype(t) == itemOp) {
+			if (t->off != p->last){p->tree->span = 0;} // right after the (
+			p->last = t->off + toklen(t);
+			Node n = pnode(p, t);
+			p->tree->node = poolnode(p->pool, &n);
+			if (p->tree->node == NULL){gperr(); return -1;}
 			return parsenOp; // parseOp
+		} else if (toktype(t) == itemEndList || toktype(t) == itemBeginList) {
+			pbackup(p); return parsenAll; // list without an op
 		}
 	}
 	return -1;
@@ -59,9 +181,10 @@ int parseOp(void *v) {
 	Parser *p = (Parser *) v;
 	Token *t;
 	while((t = pnext(p)) != NULL){
-		if (t->type == itemNum || t->type == itemChar || t->type == itemStr) {
-		} else if (t->type == itemEndList || t->type == itemBeginList) {
-			mbackup(p->tok); return parsenAll;
+		if (toktype(t) == itemNum || toktype(t) == itemChar || toktype(t) == itemStr) {
+			if (patom(p, t)){gperr(); return -1;}
+		} else if (toktype(t) == itemEndList || toktype(t) == itemBeginList) {
+			pbackup(p); return parsenAll;
 		}
 	}
 	return -1;
@@ -75,43 +198,80 @@ int parseOp(void *v) {
 
 void *parse (void *v) {
 	Basilisk *b = (Basilisk *) v;
+	tracename("parse");
+	govern(&b->gov, memParse);
 
 	// Init lexer
-	Parser p = {.errors = 0, .warns = 0};
+	Parser p = {.errors = 0, .warns = 0, .line = 1, .cons = NULL};
 
 	p.name = b->name;
+	p.errstream = b->errstream;
 	p.tok = b->tok;
+	p.cast = b->cast;
+	p.sub = subParse;
+	p.check = b->checker;
+	p.wire = b->wired == wireAst ? b->wire : NULL;
+	p.pool = b->pool;
+	p.spare = b->spare;
+	p.cancel = b->cancel;
 
-	// create root of ast
-	p.root = malloc(sizeof(AsTree));
-	p.root->node = NULL; // no node on root
-	const int len = 3;
-	p.root->tree = calloc(len, sizeof(Node *)); // allocate node pointers
-	p.root->len = len;
+	// create root of ast, reusing the ancestor stack & table
+	// left by the last parse.
+	p.root = poolast(p.pool, NULL); // no node on root
+	if (p.root == NULL){gperr(); return NULL;}
 	p.tree = p.root; // equate root to tree.
+	p.up = b->up != NULL ? b->up : initstack();
+	if (p.up == NULL){gperr(); return NULL;}
+	if (b->cons){
+		p.cons = b->table != NULL ? b->table : initcons();
+		if (p.cons == NULL){gperr(); return NULL;}
+		p.cons->pool = p.pool;
+	}
 
 	// Set up parse func array
 	stateFun parsers[] = {parseAll, parseList, parseOp};
 
-	/*Token *tok;
-	while ((tok = (Token *) mnext(p.tok)) != NULL) {
-		if (tok->type == itemEOF){gnote("EOF"); break;}
-		if (tok->type == itemErr){perr(&p, tok, tok->str, 0);}
-		else {
-			char *str = calloc(30, sizeof (char));
-			sprintf(str, "%d: %s", tok->type, tok->str);
-			gnote(str);
-		}
-	}
-	//return NULL;*/
+	// once cancelled the tree is what was parsed, its lists closed
+	int stopped = state(parsers, &p, p.cancel) || cancelled(p.cancel);
+	if (p.parenDepth > 0 && !stopped){perr(&p, &p.cur, "unclosed list", 0);}
+	while (p.tree != p.root && !pend(&p, NULL)){} // end unclosed lists
+	if ((p.check != NULL || p.wire != NULL) && psend(&p) && !cancelled(p.cancel)){gperr();}
+	if (p.check != NULL && checkend(p.check) && !cancelled(p.cancel)){gperr();}
+	if (p.cast != NULL){bdone(p.cast, p.sub);}
+	else if (p.buf != NULL){givetokbuf(p.spare, p.buf);}
 
-	state(parsers, &p);
+	// the tree is the result, kept until freeparse
+	b->root = p.root;
+	b->table = p.cons;
+	b->errors = p.errors;
+	b->warns = p.warns;
+	if (b->up == NULL){freestack(p.up);}
+	return NULL;
+}
 
-	if (p.errors > 0 || p.warns > 0) {
+// notes the errors of the last parse, and how many trees were shared
+void noteparse (Basilisk *b) {
+	if (b->checker != NULL && b->errstream != NULL){writecheck(b->checker, b->name, b->text, b->errstream);}
+	if (b->table != NULL){consnote(b->table);}
+	if (b->cancelled){gwarn("cancelled, the tree is what was parsed before");}
+	if (b->errors > 0 || b->warns > 0) {
 		char str[30];
-		sprintf(str, "%d errors, %d warning.", p.errors, p.warns);
+		sprintf(str, "%d errors, %d warning.", b->errors, b->warns);
 		gnote(str); // general note
 	}
-	return NULL;
+}
+
+// returns the tree of the last parse to the pool, or frees it,
+// the root is never shared.
+void freeparse (Basilisk *b) {
+	if (b->root == NULL){return;}
+	if (b->table != NULL){
+		if (b->pool != NULL){resetcons(b->table);}
+		else{freecons(b->table); b->table = NULL;}
+		_poolone(b->pool, b->root); // last, so it is taken first
+	} else {recycleast(b->pool, b->root);}
+	b->root = NULL;
+	b->errors = 0;
+	b->warns = 0;
 }
 
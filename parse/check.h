@@ -0,0 +1,327 @@
+#import <stdio.h> // snprintf
+#import <stdlib.h> // qsort
+#import <string.h> // memcmp
+#import <stdint.h> // uint32_t
+#import <pthread.h>
+#import "../util/concurrent.h" // MutexStack
+#import "../util/govern.h" // gsmalloc
+#import "../util/hash.h" // fnv & HashTable
+#import "../util/gerr.h" // Error
+#import "../tok/tok.h" // itemOp & builtins
+#import "ast.h" // AsTree
+
+// Semantic Checks
+// the checker runs on its own thread beside the lexer & parser: the
+// parser sends it each top-level form as it ends, and it checks the
+// arity of builtins & that other operators are bound while the parser
+// reads on. Forms may call operators defined by later forms, so uses not bound
+// within their form are looked up in every top-level define at the end.
+// Only operators are checked: the lexer takes no other names, so a
+// variable is only ever an operator, bound by define or lambda.
+// While checking, the parser's diagnostics are kept with the checker's
+// rather than written, and all are written in source order when both
+// are done.
+
+// Include guard.
+#ifndef CHECK
+#define CHECK
+
+typedef struct {
+	uint32_t off; // offset of the text it is about
+	uint32_t len;
+	int seq; // order it was made in, kept for equal offsets
+	int c; // colour & boldness of the message, as Error
+	int b;
+	int diag; // show the source
+	const char *err; // "error", "warning"...
+	char *str;
+} Diag;
+
+typedef struct {
+	AsTree *tree; // a top-level form, NULL after the last
+	char *src; // source sliced by tree
+} CheckForm;
+
+typedef struct {
+	const char *s; // text of the name
+	uint32_t len;
+	uint32_t off;
+	uint64_t h;
+} Name;
+
+// a tree being walked
+typedef struct {
+	AsTree *tree;
+	int mode; // how its subtrees are read
+	int i; // subtrees entered
+	int mark; // scope to drop back to when left, -1 to keep its bindings
+} CheckFrame;
+
+// modes
+const int checkNormal = 0;
+const int checkQuoted = 1; // not evaluated
+const int checkBinder = 2; // names are bound, as (f x) in (define (f x) ...)
+
+typedef struct {
+	MutexStack *forms; // forms from the parser
+	Governor *gov;
+	pthread_mutex_t lock; // the parser makes diagnostics too
+	Diag *diag;
+	int ndiag, maxdiag;
+	Name *def; // top-level defines
+	int ndef, maxdef;
+	HashTable defs; // of def
+	Name *use; // uses not bound within their form
+	int nuse, maxuse;
+	Name *scope; // names bound within the form
+	int nscope, maxscope;
+	CheckFrame *frame;
+	int nframe, maxframe;
+	char *src; // source of the form being checked
+	int errors;
+	int warns;
+} Checker;
+
+Checker *initcheck (Governor *gov) {
+	Checker *c = gscalloc(memCheck, 1, sizeof (Checker));
+	if (c == NULL){return NULL;}
+	c->forms = initmstack();
+	if (c->forms == NULL){return NULL;}
+	c->forms->cap = 256; // forms in flight
+	if (inithash(&c->defs, 256, memCheck)){return NULL;}
+	c->gov = gov;
+	pthread_mutex_init(&c->lock, NULL);
+	return c;
+}
+
+// drops the diagnostics & names of the last parse
+void resetcheck (Checker *c) {
+	for (int i = 0; i < c->ndiag; i++){gfree(c->diag[i].str);}
+	resethash(&c->defs);
+	c->ndiag = 0; c->ndef = 0; c->nuse = 0;
+	c->nscope = 0; c->nframe = 0;
+	c->errors = 0; c->warns = 0;
+	CheckForm *f;
+	while ((f = mleft(c->forms)) != NULL){gfree(f);} // sent before a cancel
+	resetmstack(c->forms);
+}
+
+int freecheck (Checker *c) {
+	resetcheck(c);
+	pthread_mutex_destroy(&c->lock);
+	freemstack(c->forms);
+	gfree(c->diag); gfree(c->def); gfree(c->use);
+	freehash(&c->defs);
+	gfree(c->scope); gfree(c->frame);
+	gfree(c);
+	return 0;
+}
+
+// makes room for one more of n items in *v, doubling it
+int _checkroom (void **v, int *max, int n, size_t size) {
+	if (n < *max){return 0;}
+	int m = *max > 0 ? *max * 2 : 64;
+	void *w = gsrealloc(memCheck, *v, m * size);
+	if (w == NULL){return 1;}
+	*v = w;
+	*max = m;
+	return 0;
+}
+
+// Diagnostics
+
+// records a diagnostic, from either thread
+int checkdiag (Checker *c, uint32_t off, uint32_t len, const char *str, int col, int bold, const char *err, int diag) {
+	size_t n = strlen(str) + 1;
+	char *s = gsmalloc(memCheck, n);
+	if (s == NULL){return 1;}
+	memcpy(s, str, n);
+	pthread_mutex_lock(&c->lock);
+	int fail = _checkroom((void **) &c->diag, &c->maxdiag, c->ndiag, sizeof (Diag));
+	if (!fail){
+		Diag d = {.off = off, .len = len, .seq = c->ndiag, .c = col, .b = bold, .diag = diag, .err = err, .str = s};
+		c->diag[c->ndiag++] = d;
+	}
+	pthread_mutex_unlock(&c->lock);
+	if (fail){gfree(s);}
+	return fail;
+}
+
+int _checkerr (Checker *c, Node *n, const char *str) {
+	c->errors++;
+	return checkdiag(c, n->off, n->len, str, 31, 1, "error", 1);
+}
+
+int _checkwarn (Checker *c, Name *n, const char *str) {
+	c->warns++;
+	return checkdiag(c, n->off, n->len, str, 35, 1, "warning", 1);
+}
+
+int _cmpdiag (const void *a, const void *b) {
+	const Diag *p = a, *q = b;
+	if (p->off != q->off){return p->off < q->off ? -1 : 1;}
+	return p->seq - q->seq;
+}
+
+// writes the diagnostics in source order, text is the whole source
+void writecheck (Checker *c, char *name, char *text, FILE *stream) {
+	qsort(c->diag, c->ndiag, sizeof (Diag), _cmpdiag);
+	int line = 1;
+	char *s = text, *nl;
+	for (int i = 0; i < c->ndiag; i++){
+		Diag *d = &c->diag[i];
+		char *end = &text[d->off];
+		while ((nl = memchr(s, '\n', end - s)) != NULL){line++; s = nl + 1;}
+		int len = d->len;
+		Error e = {.read = end, .rdlen = &len, .line = line, .ch = end - s + 1, .c = d->c, .b = d->b, .diag = d->diag, .str = d->str, .err = (char *) d->err, .name = name};
+		_err(&e, stream);
+	}
+}
+
+// Names
+
+Name _checkname (Checker *c, Node *n) {
+	Name m = {.s = &c->src[n->off], .len = n->len, .off = n->off};
+	m.h = fnv(FnvBasis, m.s, m.len);
+	return m;
+}
+
+int _samename (Name *a, Name *b) {
+	return a->h == b->h && a->len == b->len && memcmp(a->s, b->s, a->len) == 0;
+}
+
+int _checkeq (void *v, long i, const void *key) {
+	Checker *c = (Checker *) v;
+	return _samename(&c->def[i], (Name *) key);
+}
+
+// slot of n in the defines, or the empty slot it would go in
+long _checkslot (Checker *c, Name *n) {return hashfind(&c->defs, n->h, _checkeq, c, n);}
+
+// defines n at the top level
+int _checkdefine (Checker *c, Name *n) {
+	if (hashroom(&c->defs)){return 1;}
+	long s = _checkslot(c, n);
+	if (hashat(&c->defs, s) >= 0){return 0;}
+	if (_checkroom((void **) &c->def, &c->maxdef, c->ndef, sizeof (Name))){return 1;}
+	c->def[c->ndef] = *n;
+	hashput(&c->defs, s, n->h, c->ndef++);
+	return 0;
+}
+
+int _checkbind (Checker *c, Name *n) {
+	if (_checkroom((void **) &c->scope, &c->maxscope, c->nscope, sizeof (Name))){return 1;}
+	c->scope[c->nscope++] = *n;
+	return 0;
+}
+
+// a use of n: bound within the form, or looked up at the end
+int _checkuse (Checker *c, Name *n) {
+	for (int i = c->nscope - 1; i >= 0; i--){
+		if (_samename(&c->scope[i], n)){return 0;}
+	}
+	if (_checkroom((void **) &c->use, &c->maxuse, c->nuse, sizeof (Name))){return 1;}
+	c->use[c->nuse++] = *n;
+	return 0;
+}
+
+// Walking
+// each tree is read in the mode its parent gives it: the first
+// subtree of define & lambda binds names, and quote's subtrees are
+// not evaluated.
+
+int _checkarity (Checker *c, AsTree *tree) {
+	Node *n = tree->node;
+	int min = opMinArgs[n->op], max = opMaxArgs[n->op];
+	if (tree->len >= min && (max < 0 || tree->len <= max)){return 0;}
+	char str[100];
+	if (tree->len < min){snprintf(str, sizeof str, "%s takes at least %d arguments, not %d", opName[n->op], min, tree->len);}
+	else{snprintf(str, sizeof str, "%s takes at most %d arguments, not %d", opName[n->op], max, tree->len);}
+	return _checkerr(c, n, str);
+}
+
+int _checkvisit (AsTree *tree, int depth, int exit, void *v) {
+	(void) depth; // frames are kept by the checker
+	Checker *c = (Checker *) v;
+	if (exit){
+		CheckFrame *f = &c->frame[--c->nframe];
+		if (f->mark >= 0){c->nscope = f->mark;}
+		return 0;
+	}
+
+	// mode, from the parent
+	CheckFrame *up = c->nframe > 0 ? &c->frame[c->nframe - 1] : NULL;
+	int mode = checkNormal, global = 0;
+	if (up != NULL){
+		int i = up->i++;
+		int op = up->tree->node != NULL ? up->tree->node->op : opNone;
+		if (up->mode == checkQuoted || op == opQuote){mode = checkQuoted;}
+		else if (up->mode == checkBinder){mode = checkBinder;}
+		else if (i == 0 && (op == opDefine || op == opLambda)){
+			mode = checkBinder;
+			global = op == opDefine && c->nframe == 1; // names a top-level define
+		}
+	}
+
+	// the list's operator, atoms have none
+	Node *n = tree->node;
+	int err = 0;
+	if (n != NULL && n->type == itemOp && mode != checkQuoted){
+		Name name = _checkname(c, n);
+		if (global){err = _checkdefine(c, &name);}
+		else if (mode == checkBinder){err = _checkbind(c, &name);}
+		else if (n->op != opNone){err = _checkarity(c, tree);}
+		else{err = _checkuse(c, &name);}
+	}
+
+	if (err || _checkroom((void **) &c->frame, &c->maxframe, c->nframe, sizeof (CheckFrame))){return 1;}
+	// defines bind in the scope around them
+	int keep = mode != checkNormal || (n != NULL && n->op == opDefine);
+	CheckFrame f = {.tree = tree, .mode = mode, .i = 0, .mark = keep ? -1 : c->nscope};
+	c->frame[c->nframe++] = f;
+	return 0;
+}
+
+// Forms
+// forms are sent to the checker by the parser, which reads on.
+
+int checkform (Checker *c, AsTree *tree, char *src) {
+	CheckForm *f = gsmalloc(memCheck, sizeof (CheckForm));
+	if (f == NULL){return 1;}
+	f->tree = tree;
+	f->src = src;
+	if (mpush(c->forms, f)){gfree(f); return 1;}
+	return 0;
+}
+
+// no more forms
+int checkend (Checker *c) {return checkform(c, NULL, NULL);}
+
+// checks forms until the last, then warns of uses never defined.
+// Once cancelled, uses may be defined by forms never parsed.
+void *checkforms (void *v) {
+	Checker *c = (Checker *) v;
+	tracename("check");
+	govern(c->gov, memCheck);
+	CheckForm *f;
+	while ((f = mnext(c->forms)) != NULL && f->tree != NULL){
+		c->src = f->src;
+		if (walkast(f->tree, _checkvisit, c)){gperr();}
+		c->nscope = 0;
+		c->nframe = 0;
+		gfree(f);
+	}
+	if (f == NULL){return NULL;}
+	gfree(f);
+
+	for (int i = 0; i < c->nuse; i++){
+		Name *n = &c->use[i];
+		if (hashat(&c->defs, _checkslot(c, n)) >= 0){continue;}
+		char str[100];
+		snprintf(str, sizeof str, "%.*s is not defined", n->len > 60 ? 60 : (int) n->len, n->s);
+		if (_checkwarn(c, n, str)){gperr(); break;}
+	}
+	return NULL;
+}
+
+#endif // CHECK
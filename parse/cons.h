@@ -0,0 +1,133 @@
+#import <stdint.h> // uint64_t
+#import <stdlib.h> // calloc
+#import <string.h> // memcmp
+#import "ast.h" // abstract syntax tree
+#import "../util/hash.h" // fnv & HashTable
+
+// Hash Consing
+// every finished subtree is looked up by its node type, text and
+// children, so identical subtrees are one shared, immutable tree.
+// Children are interned before their parent, so comparing children
+// is a pointer compare and two subtrees are equal only if they are
+// the same pointer. Interned trees are numbered from 1 by id, giving
+// later passes a dense index to memoize on.
+// The table owns every interned tree, they must not be freed with
+// freeast.
+
+typedef struct {
+	AsTree **trees; // unique trees, by id - 1
+	int len; // unique trees
+	int max;
+	HashTable set; // of trees
+	long total; // trees interned, including duplicates
+	char *src; // source the tree being interned slices
+	AstPool *pool; // where duplicates go, or NULL to free them
+} ConsTable;
+
+const int ConsTableLen = 1024;
+
+ConsTable *initcons () {
+	ConsTable *table = gsmalloc(memAst, sizeof (ConsTable));
+	if (table == NULL){return NULL;}
+
+	table->trees = gsmalloc(memAst, ConsTableLen / 2 * sizeof (AsTree *));
+	if (table->trees == NULL || inithash(&table->set, ConsTableLen, memAst)){return NULL;}
+
+	table->len = 0;
+	table->max = ConsTableLen / 2;
+	table->total = 0;
+	table->src = NULL;
+	table->pool = NULL;
+	return table;
+}
+
+// frees the table & every tree in it
+int freecons (ConsTable *table) {
+	for (int i = 0; i < table->len; i++){
+		AsTree *tree = table->trees[i];
+		gfree(tree->tree); // children are freed as trees of their own
+		gfree(tree->node);
+		gfree(tree);
+	}
+	gfree(table->trees);
+	freehash(&table->set);
+	gfree(table);
+	return 0;
+}
+
+// empties the table, returning every tree in it to the pool
+// & keeping its slots.
+int resetcons (ConsTable *table) {
+	for (int i = 0; i < table->len; i++){_poolone(table->pool, table->trees[i]);}
+	resethash(&table->set);
+	table->len = 0;
+	table->total = 0;
+	return 0;
+}
+
+uint64_t _hashast (AsTree *tree, char *src) {
+	uint64_t h = FnvBasis;
+	if (tree->node != NULL){
+		h = fnv(h, &tree->node->type, sizeof tree->node->type);
+		h = fnv(h, &src[tree->node->off], tree->node->len);
+	}
+	for (int i = 0; i < tree->len; i++){
+		h = fnv(h, &((AsTree *) tree->tree[i])->id, sizeof (int));
+	}
+	return h;
+}
+
+// are a & b the same, given that their children are interned?
+int _eqast (AsTree *a, AsTree *b, char *src) {
+	if (a->len != b->len){return 0;}
+	if ((a->node == NULL) != (b->node == NULL)){return 0;}
+	if (a->node != NULL){
+		if (a->node->type != b->node->type){return 0;}
+		if (a->node->len != b->node->len){return 0;}
+		if (memcmp(&src[a->node->off], &src[b->node->off], a->node->len)){return 0;}
+	}
+	for (int i = 0; i < a->len; i++){
+		if (a->tree[i] != b->tree[i]){return 0;}
+	}
+	return 1;
+}
+
+int _conseq (void *v, long i, const void *key) {
+	ConsTable *table = (ConsTable *) v;
+	return _eqast(table->trees[i], (AsTree *) key, table->src);
+}
+
+// intern a finished tree whose children are all interned,
+// src is the source its nodes slice.
+// Returns the shared tree, freeing tree if it was a duplicate.
+AsTree *intern (ConsTable *table, AsTree *tree, char *src) {
+	if (hashroom(&table->set)){return NULL;}
+	if (table->len >= table->max){
+		AsTree **trees = gsrealloc(memAst, table->trees, table->max * 2 * sizeof (AsTree *));
+		if (trees == NULL){return NULL;}
+		table->trees = trees;
+		table->max *= 2;
+	}
+	table->total++;
+	table->src = src;
+	uint64_t h = _hashast(tree, src);
+	long s = hashfind(&table->set, h, _conseq, table, tree);
+	long i = hashat(&table->set, s);
+	if (i >= 0){
+		_poolone(table->pool, tree);
+		return table->trees[i];
+	}
+
+	table->trees[table->len] = tree;
+	hashput(&table->set, s, h, table->len);
+	tree->id = ++table->len;
+	return tree;
+}
+
+// consnote notes how many trees were shared
+void consnote (ConsTable *table) {
+	char str[100];
+	double ratio = table->len > 0 ? (double) table->total / table->len : 1;
+	snprintf(str, sizeof str, "%ld subtrees, %d unique (%.2fx deduplication).", table->total, table->len, ratio);
+	gnote(str);
+}
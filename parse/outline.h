@@ -0,0 +1,237 @@
+#import <stdio.h> // printf
+#import <stdint.h> // uint32_t
+#import <string.h> // memchr
+#import <fcntl.h> // open
+#import <unistd.h> // close
+#import <sys/mman.h> // mmap
+#import <sys/stat.h> // fstat
+#if defined(__SSE2__)
+#import <emmintrin.h> // _mm_cmpeq_epi8
+#endif
+#import "../context.h" // lexer & parser
+#import "../lex/literal.h" // litscan
+
+// Outline
+// an outline is the list of top-level forms of a source, found by
+// matching parens over the raw bytes without lexing: each form has
+// its span & head operator. Strings, chars & comments are skipped
+// as the lexer would, escapes and all, so parens inside them are not
+// counted.
+// The tree of a form is only parsed the first time it is asked for.
+
+// Include guard.
+#ifndef OUTLINE
+#define OUTLINE
+
+typedef struct {
+	uint32_t off; // offset of the form's (
+	uint32_t len; // length up to & including its ), or to the end if unclosed
+	uint32_t head; // length of the operator at off + 1, 0 for none
+	int op; // builtin id of the operator
+	AsTree *tree; // parsed tree, or NULL until it is asked for
+} Form;
+
+typedef struct {
+	char *src; // source, not copied
+	uint32_t len;
+	Form *form;
+	int nform;
+	int maxform;
+	int unclosed; // is the last form unclosed?
+	int stray; // )s outside any form
+	Basilisk *b; // context forms are parsed with
+} Outline;
+
+// offset of the next ( ) " ' or ; at or after i, or n
+uint32_t _outlinenext (const char *s, uint32_t i, uint32_t n) {
+#if defined(__SSE2__)
+	const __m128i paren = _mm_set1_epi8(')'); // ( is ) with the low bit clear
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i str = _mm_set1_epi8('"');
+	const __m128i chr = _mm_set1_epi8('\'');
+	const __m128i com = _mm_set1_epi8(';');
+	for (; i + 16 <= n; i += 16){
+		__m128i v = _mm_loadu_si128((const __m128i *) &s[i]);
+		__m128i m = _mm_cmpeq_epi8(_mm_or_si128(v, one), paren);
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, str));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, chr));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, com));
+		int bits = _mm_movemask_epi8(m);
+		if (bits){return i + __builtin_ctz(bits);}
+	}
+#endif
+	for (; i < n; i++){
+		char c = s[i];
+		if (c == '(' || c == ')' || c == '"' || c == '\'' || c == ';'){return i;}
+	}
+	return n;
+}
+
+// offset just past the next c at or after i, or n
+uint32_t _outlinepast (const char *s, char c, uint32_t i, uint32_t n) {
+	const char *p = memchr(&s[i], c, n - i);
+	return p == NULL ? n : (uint32_t) (p - s) + 1;
+}
+
+int _pushform (Outline *o, Form *f) {
+	if (o->nform >= o->maxform){
+		int max = o->maxform > 0 ? o->maxform * 2 : 64;
+		Form *v = grealloc(o->form, max * sizeof (Form));
+		if (v == NULL){return 1;}
+		o->form = v;
+		o->maxform = max;
+	}
+	o->form[o->nform++] = *f;
+	return 0;
+}
+
+// finds the top-level forms of src
+int scanoutline (Outline *o) {
+	const char *s = o->src;
+	uint32_t n = o->len, i = 0;
+	int depth = 0;
+	Form f;
+	while ((i = _outlinenext(s, i, n)) < n){
+		char c = s[i++];
+		if (c == ';'){i = _outlinepast(s, '\n', i, n);}
+		else if (c == '(' && depth++ == 0){
+			f.off = i - 1;
+			f.head = 0;
+			while (i + f.head < n && isopchar(s[i + f.head])){f.head++;}
+			f.op = f.head > 0 ? opid(&s[i], f.head) : opNone;
+			f.tree = NULL;
+		} else if (c == ')'){
+			if (depth == 0){o->stray++; continue;}
+			if (--depth == 0){
+				f.len = i - f.off;
+				if (_pushform(o, &f)){return 1;}
+			}
+		} else if (depth > 0 && (c == '"' || c == '\'')){
+			int flags = 0;
+			i = litscan(s, i, n, c, &flags);
+			i = flags & litClosed ? i + 1 : n;
+		}
+	}
+	if (depth > 0){
+		f.len = n - f.off;
+		o->unclosed = 1;
+		if (_pushform(o, &f)){return 1;}
+	}
+	return 0;
+}
+
+// frees the outline & the trees parsed, not src
+int freeoutline (Outline *o) {
+	for (int i = 0; i < o->nform; i++){
+		if (o->form[i].tree != NULL){recycleast(o->b->pool, o->form[i].tree);}
+	}
+	gfree(o->form);
+	gfree(o);
+	return 0;
+}
+
+// outlines len bytes of src, whose forms are parsed with b
+Outline *initoutline (Basilisk *b, char *src, uint32_t len) {
+	Outline *o = gcalloc(1, sizeof (Outline));
+	if (o == NULL){return NULL;}
+	o->src = src;
+	o->len = len;
+	o->b = b;
+	if (scanoutline(o)){freeoutline(o); return NULL;}
+	return o;
+}
+
+// tree of form i, parsed the first time it is asked for.
+// The form is lexed then parsed on this thread, with the token stack
+// uncapped so the lexer need not wait for the parser.
+AsTree *outlinetree (Outline *o, int i) {
+	Form *f = &o->form[i];
+	if (f->tree != NULL){return f->tree;}
+	Basilisk *b = o->b;
+	resetcontext(b);
+	b->buf = o->src;
+	b->bufoff = f->off;
+	b->buflen = f->off + f->len;
+	int cap = b->tok->cap, cons = b->cons;
+	Broadcast *cast = b->cast;
+	Checker *checker = b->checker;
+	b->tok->cap = 0;
+	b->cons = 0; // trees of forms are kept apart
+	b->cast = NULL; // nor are they highlighted or checked
+	b->checker = NULL;
+	Governor *gov = governor;
+	int stage = memStage;
+	lex(b);
+	parse(b);
+	govern(gov, stage);
+	b->tok->cap = cap;
+	b->cons = cons;
+	b->cast = cast;
+	b->checker = checker;
+	b->bufoff = 0;
+	f->tree = b->root;
+	b->root = NULL;
+	return f->tree;
+}
+
+// prints each form as name:offset, length & head
+void printoutline (Outline *o, const char *name, FILE *stream) {
+	for (int i = 0; i < o->nform; i++){
+		Form *f = &o->form[i];
+		fprintf(stream, "%s:%u\t%u\t%.*s\n", name, f->off, f->len, (int) f->head, &o->src[f->off + 1]);
+	}
+}
+
+// Reading
+// outlines need all of the source at once: regular, uncompressed
+// files are mapped, anything else is read through an Input.
+
+typedef struct {
+	char *src;
+	long len;
+	int mapped; // src is mapped, not allocated
+} OutlineSrc;
+
+int readoutline (OutlineSrc *r, FILE *stream) {
+	struct stat st;
+	int fd = fileno(stream);
+	r->mapped = 0;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 4){
+		r->len = st.st_size;
+		r->src = mmap(NULL, r->len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (r->src != MAP_FAILED){
+			if (memcmp(r->src, gzipMagic, 2) && memcmp(r->src, zstdMagic, 4)){
+				r->mapped = 1;
+				madvise(r->src, r->len, MADV_SEQUENTIAL);
+				return 0;
+			}
+			munmap(r->src, r->len);
+		}
+	}
+
+	Input *in = initinput();
+	if (in == NULL || startinput(in, stream)){return 1;}
+	long max = InputBufLen, n = 0;
+	char *blk;
+	r->src = gmalloc(max);
+	r->len = 0;
+	while (r->src != NULL && (n = inext(in, &blk)) > 0){
+		while (r->len + n > max){
+			char *v = grealloc(r->src, max * 2);
+			if (v == NULL){gfree(r->src); r->src = NULL; break;}
+			r->src = v;
+			max *= 2;
+		}
+		if (r->src != NULL){memcpy(&r->src[r->len], blk, n); r->len += n;}
+	}
+	stopinput(in);
+	freeinput(in);
+	return r->src == NULL || n < 0;
+}
+
+void freeoutlinesrc (OutlineSrc *r) {
+	if (r->mapped){munmap(r->src, r->len);}
+	else{gfree(r->src);}
+}
+
+#endif // OUTLINE
@@ -1,17 +1,40 @@
 #import <stdio.h> // printing
 #import <stdlib.h> // calloc, exit, etc.
+#import <string.h> // memchr
 #import "../util/gerr.h" // general errors
+#import "../util/broadcast.h" // Broadcast
+#import "../wire/write.h" // Wire
 
 // Parser type
 typedef struct {
 	char *name; // name of file
+	FILE *errstream; // stream to error, or NULL to only count
 	int errors;
 	int warns;
 	int parenDepth;
 	MutexStack *tok; // tok
+	Broadcast *cast; // token broadcast, or NULL to read tok
+	int sub; // subscriber number in cast
 	int len; // tok is read from bottom, length read
+	TokBuf *buf; // token buffer being read
+	int i; // index of next token in buf
+	int erri; // index of next error message in buf
+	int back; // return cur again on next read
+	uint32_t last; // offset past the last token put in the tree
+	Token cur; // last token read
+	char *src; // source sliced by tokens
+	int line; // line of lineoff
+	int lineoff; // offset of last line found by ppos
 	AsTree *root; // root of tree
 	AsTree *tree; // current location in tree
+	Stack *up; // ancestors of tree
+	ConsTable *cons; // table of shared subtrees, or NULL
+	AstPool *pool; // spare trees, or NULL
+	TokPool *spare; // where read token buffers go, or NULL
+	Checker *check; // where forms & diagnostics go, or NULL
+	Wire *wire; // where forms are streamed, or NULL
+	int sent; // top-level forms sent to check & wire
+	Cancel *cancel; // stops the parse once cancelled, or NULL
 } Parser;
 
 // Errors
@@ -20,10 +43,26 @@ typedef struct {
 // one cannot return -1 to the state machine.
 // each function makes a call to _err, which is contained in gerr.h.
 
+// ppos finds the line and character of a token,
+// errors come in source order so it counts on from the last one.
+void ppos(Parser *p, Token *t, int *line, int *ch) {
+	if (t->off < (uint32_t) p->lineoff){p->line = 1; p->lineoff = 0;}
+	char *s = &p->src[p->lineoff], *end = &p->src[t->off], *nl;
+	while ((nl = memchr(s, '\n', end - s)) != NULL){
+		p->line++; s = nl + 1;
+	}
+	p->lineoff = s - p->src;
+	*line = p->line;
+	*ch = t->off - p->lineoff + 1;
+}
+
 // perr (parse error), a simplified wrapper for _err
 void pperr(Parser *p, Token *t, char *str, int c, int b, char *err, int diag) {
-	Error ptr = { .read = t->str, .rdlen = &t->ch, .line = t->line, .ch = t->ch, .c = c, .b = b, .diag = diag, .str = str, .err = err, .name = p->name };
-	_err(&ptr, stderr);
+	int line, ch, len = toklen(t);
+	if (p->check != NULL){checkdiag(p->check, t->off, len, str, c, b, err, diag); return;} // written in order later
+	ppos(p, t, &line, &ch);
+	Error ptr = { .read = &p->src[t->off], .rdlen = &len, .line = line, .ch = ch, .c = c, .b = b, .diag = diag, .str = str, .err = err, .name = p->name };
+	if (p->errstream != NULL){_err(&ptr, p->errstream);}
 }
 
 // general errors
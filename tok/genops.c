@@ -0,0 +1,108 @@
+#import <stdio.h> // printf
+#import <stdlib.h> // exit
+#import <string.h> // strcmp
+#import "ophash.h" // ophash
+
+// Generates ops.h, the builtin operator table, from the list of
+// operators read from stdin:
+//
+//	cc tok/genops.c -o genops && ./genops < tok/ops > tok/ops.h
+//
+// Buckets are displaced biggest first, trying displacements until
+// each bucket's names land in free slots.
+
+#define OpMax 255 // ids must fit a byte
+#define DispMax 65536
+
+typedef struct {
+	char name[64];
+	char ident[64];
+	int min, max; // arguments taken, max -1 for no most
+	uint32_t h;
+} Op;
+
+Op ops[OpMax];
+int nops = 0;
+
+int bucketlen (int b, int nb) {
+	int n = 0;
+	for (int i = 0; i < nops; i++){n += (int) (ops[i].h % nb) == b;}
+	return n;
+}
+
+int main () {
+	char line[256];
+	while (fgets(line, sizeof line, stdin) != NULL){
+		if (line[0] == '#' || line[0] == '\n'){continue;}
+		if (nops >= OpMax){fprintf(stderr, "genops: too many operators\n"); exit(1);}
+		Op *op = &ops[nops];
+		char max[16];
+		if (sscanf(line, "%63s %63s %d %15s", op->name, op->ident, &op->min, max) != 4){fprintf(stderr, "genops: bad line: %s", line); exit(1);}
+		op->max = strcmp(max, "*") == 0 ? -1 : atoi(max);
+		for (int i = 0; i < nops; i++){
+			if (strcmp(ops[i].name, op->name) == 0){fprintf(stderr, "genops: %s listed twice\n", op->name); exit(1);}
+		}
+		op->h = ophash(op->name, strlen(op->name));
+		nops++;
+	}
+	if (nops == 0){fprintf(stderr, "genops: no operators\n"); exit(1);}
+
+	int nb = (nops + 1) / 2; // buckets
+	int order[OpMax], disp[OpMax], slot[OpMax];
+	for (int b = 0; b < nb; b++){order[b] = b; disp[b] = 0;}
+	for (int i = 0; i < nops; i++){slot[i] = 0;}
+	// biggest buckets first
+	for (int i = 1; i < nb; i++){
+		for (int j = i; j > 0 && bucketlen(order[j], nb) > bucketlen(order[j - 1], nb); j--){
+			int t = order[j]; order[j] = order[j - 1]; order[j - 1] = t;
+		}
+	}
+	for (int k = 0; k < nb; k++){
+		int b = order[k], d;
+		for (d = 0; d < DispMax; d++){
+			int used[OpMax] = {0}, ok = 1;
+			for (int i = 0; i < nops && ok; i++){
+				if ((int) (ops[i].h % nb) != b){continue;}
+				uint32_t s = opslot(ops[i].h, d, nops);
+				ok = !slot[s] && !used[s];
+				used[s] = 1;
+			}
+			if (ok){break;}
+		}
+		if (d == DispMax){fprintf(stderr, "genops: no displacement for bucket %d\n", b); exit(1);}
+		disp[b] = d;
+		for (int i = 0; i < nops; i++){
+			if ((int) (ops[i].h % nb) == b){slot[opslot(ops[i].h, d, nops)] = i + 1;}
+		}
+	}
+
+	printf("#import <stdint.h> // uint8_t\n");
+	printf("#import <string.h> // memcmp\n");
+	printf("#import \"ophash.h\" // ophash\n\n");
+	printf("// Builtin Operators\n");
+	printf("// generated by genops.c from ops, do not edit.\n\n");
+	printf("// Include guard.\n#ifndef OPS\n#define OPS\n\n");
+	printf("// ids, 0 is not a builtin\nconst int opNone = 0;\n");
+	for (int i = 0; i < nops; i++){printf("const int op%s = %d;\n", ops[i].ident, i + 1);}
+	printf("\n#define OpLen %d\n#define OpBuckets %d\n\n", nops, nb);
+	printf("// name of each id\nconst char *opName[OpLen + 1] = {NULL");
+	for (int i = 0; i < nops; i++){printf(", \"%s\"", ops[i].name);}
+	printf("};\n\nconst uint8_t opNameLen[OpLen + 1] = {0");
+	for (int i = 0; i < nops; i++){printf(", %d", (int) strlen(ops[i].name));}
+	printf("};\n\n// fewest & most arguments of each id, -1 for no most\nconst int8_t opMinArgs[OpLen + 1] = {0");
+	for (int i = 0; i < nops; i++){printf(", %d", ops[i].min);}
+	printf("};\n\nconst int8_t opMaxArgs[OpLen + 1] = {-1");
+	for (int i = 0; i < nops; i++){printf(", %d", ops[i].max);}
+	printf("};\n\n// displacement of each bucket\nconst uint16_t opDisp[OpBuckets] = {");
+	for (int b = 0; b < nb; b++){printf("%s%d", b ? ", " : "", disp[b]);}
+	printf("};\n\n// id in each slot\nconst uint8_t opSlot[OpLen] = {");
+	for (int s = 0; s < nops; s++){printf("%s%d", s ? ", " : "", slot[s]);}
+	printf("};\n\n");
+	printf("// id of the builtin named by the n bytes at s, or opNone\n");
+	printf("int opid (const char *s, uint32_t n) {\n");
+	printf("\tuint32_t h = ophash(s, n);\n");
+	printf("\tint id = opSlot[opslot(h, opDisp[h %% OpBuckets], OpLen)];\n");
+	printf("\tif (opNameLen[id] != n || memcmp(opName[id], s, n) != 0){return opNone;}\n");
+	printf("\treturn id;\n}\n\n#endif // OPS\n");
+	return 0;
+}
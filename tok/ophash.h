@@ -0,0 +1,25 @@
+#import <stdint.h> // uint32_t
+
+// Operator Hash
+// builtin operators are found with a minimal perfect hash: the hash
+// of a name picks a bucket, the bucket's displacement moves it to
+// its own slot. ops.h holds the displacements, made by genops.c.
+
+// Include guard.
+#ifndef OPHASH
+#define OPHASH
+
+// fnv-1a over n bytes, 32 bits is plenty for a few dozen names
+uint32_t ophash (const char *s, uint32_t n) {
+	uint32_t h = 2166136261u;
+	for (uint32_t i = 0; i < n; i++){h = (h ^ (unsigned char) s[i]) * 16777619u;}
+	return h;
+}
+
+// slot of hash h in a table of len, displaced by d
+uint32_t opslot (uint32_t h, uint32_t d, uint32_t len) {
+	h = (h ^ d) * 0x9e3779b1u;
+	return (h ^ h >> 16) % len;
+}
+
+#endif // OPHASH
@@ -0,0 +1,70 @@
+#import <stdint.h> // uint8_t
+#import <string.h> // memcmp
+#import "ophash.h" // ophash
+
+// Builtin Operators
+// generated by genops.c from ops, do not edit.
+
+// Include guard.
+#ifndef OPS
+#define OPS
+
+// ids, 0 is not a builtin
+const int opNone = 0;
+const int opAdd = 1;
+const int opSub = 2;
+const int opMul = 3;
+const int opDiv = 4;
+const int opMod = 5;
+const int opLt = 6;
+const int opGt = 7;
+const int opLe = 8;
+const int opGe = 9;
+const int opEq = 10;
+const int opNe = 11;
+const int opAnd = 12;
+const int opOr = 13;
+const int opNot = 14;
+const int opDefine = 15;
+const int opIf = 16;
+const int opCond = 17;
+const int opLambda = 18;
+const int opLet = 19;
+const int opBegin = 20;
+const int opSet = 21;
+const int opQuote = 22;
+const int opCons = 23;
+const int opCar = 24;
+const int opCdr = 25;
+const int opList = 26;
+const int opEqp = 27;
+const int opPrint = 28;
+
+#define OpLen 28
+#define OpBuckets 14
+
+// name of each id
+const char *opName[OpLen + 1] = {NULL, "+", "-", "*", "/", "%", "<", ">", "<=", ">=", "=", "!=", "and", "or", "not", "define", "if", "cond", "lambda", "let", "begin", "set", "quote", "cons", "car", "cdr", "list", "eq", "print"};
+
+const uint8_t opNameLen[OpLen + 1] = {0, 1, 1, 1, 1, 1, 1, 1, 2, 2, 1, 2, 3, 2, 3, 6, 2, 4, 6, 3, 5, 3, 5, 4, 3, 3, 4, 2, 5};
+
+// fewest & most arguments of each id, -1 for no most
+const int8_t opMinArgs[OpLen + 1] = {0, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 0, 0, 1, 2, 2, 1, 2, 2, 1, 2, 1, 2, 1, 1, 0, 2, 1};
+
+const int8_t opMaxArgs[OpLen + 1] = {-1, -1, -1, -1, -1, 2, -1, -1, -1, -1, -1, 2, -1, -1, 1, -1, 3, -1, -1, -1, -1, 2, 1, 2, 1, 1, -1, 2, -1};
+
+// displacement of each bucket
+const uint16_t opDisp[OpBuckets] = {1, 0, 12, 0, 22, 20, 2, 0, 0, 7, 22, 16, 24, 40};
+
+// id in each slot
+const uint8_t opSlot[OpLen] = {4, 2, 22, 16, 19, 27, 25, 8, 14, 11, 3, 18, 15, 23, 10, 21, 6, 17, 5, 9, 1, 26, 20, 7, 12, 28, 13, 24};
+
+// id of the builtin named by the n bytes at s, or opNone
+int opid (const char *s, uint32_t n) {
+	uint32_t h = ophash(s, n);
+	int id = opSlot[opslot(h, opDisp[h % OpBuckets], OpLen)];
+	if (opNameLen[id] != n || memcmp(opName[id], s, n) != 0){return opNone;}
+	return id;
+}
+
+#endif // OPS
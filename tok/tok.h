@@ -1,6 +1,8 @@
+#import <stdint.h> // uint32_t
 #import <strings.h>
 #import "../util/gerr.h" // errors
 #import "../util/concurrent.h" // MutexStack
+#import "ops.h" // builtin operators
 
 // eof
 const int itemEOF = -1;
@@ -22,49 +24,180 @@ const int itemChar = 22;
 const int itemStr = 23;
 
 // Token
+// packed into 8 bytes, the type shares a word with the length
+// and the text is a slice of the source at off, never copied.
 typedef struct {
-	int type; // type number
-	int line; // line number
-	int ch; // char on line number
-	char *str; // lexed text
+	uint32_t off; // offset of text in source
+	uint32_t kind; // type << 24 | length
 } Token;
 
-// create a lasting error, given an error where elements
-// will go out of scope.
-Token *_copytok (Token *tok) {
-	// Create new error
-	Token *token = malloc(sizeof (Token)); // allocate on heap.
-	if (token == NULL){free(token); return NULL;} // token check.
-
-	// copy ints from value
-	token->type = tok->type;
-	token->line = tok->line;
-	token->ch = tok->ch;
-	// Allocate space, pointer may go out of scope.
-	// We are using this for strlcpy so there is no overflow.
-	size_t size = 100 * sizeof (char);
-
-	token->str = (char *) malloc(size);
-	if (token->str == NULL){return NULL;} // token
-	strlcpy(token->str, tok->str, (long) size);
-
-	return token;
+// longest text a token can slice
+const uint32_t TokLenMax = (1 << 24) - 1;
+
+// type number of a token
+int toktype (Token *t) {return (int8_t) (t->kind >> 24);}
+
+// length of the lexed text
+int toklen (Token *t) {return t->kind & TokLenMax;}
+
+// Token Buffer
+// tokens are stored as a structure of arrays, filled by the lexer
+// TokBufLen at a time and handed to the parser whole.
+// src is the source the offsets refer to, errors holds the message
+// of each itemErr token, in order.
+// op holds the builtin id of each itemOp token, opNone otherwise.
+// triv is only kept when asked for, it holds the length of the
+// whitespace & comments skipped before each token.
+typedef struct {
+	uint32_t *off; // offsets of tokens
+	uint32_t *kind; // kinds of tokens
+	uint8_t *op; // builtin ids of tokens
+	uint32_t *triv; // leading trivia of tokens, or NULL
+	int len; // number of tokens
+	int max; // capacity
+	char *src; // source sliced by tokens
+	Stack *errors; // itemErr messages
+	void *next; // next spare TokBuf in a TokPool (void to avoid recursive definition)
+} TokBuf;
+
+const int TokBufLen = 1024;
+
+TokBuf *inittokbuf (int trivia) {
+	TokBuf *buf = gsmalloc(memTok, sizeof (TokBuf));
+	if (buf == NULL){return NULL;}
+
+	buf->off = gsmalloc(memTok, TokBufLen * sizeof (uint32_t));
+	buf->kind = gsmalloc(memTok, TokBufLen * sizeof (uint32_t));
+	buf->op = gsmalloc(memTok, TokBufLen * sizeof (uint8_t));
+	buf->triv = NULL;
+	if (trivia){
+		buf->triv = gsmalloc(memTok, TokBufLen * sizeof (uint32_t));
+		if (buf->triv == NULL){return NULL;}
+	}
+	buf->errors = initstack();
+	if (buf->off == NULL || buf->kind == NULL || buf->op == NULL || buf->errors == NULL){return NULL;}
+
+	buf->len = 0;
+	buf->max = TokBufLen;
+	buf->src = NULL;
+	buf->next = NULL;
+	return buf;
+}
+
+int freetokbuf (TokBuf *buf) {
+	char *str;
+	while ((str = pop(buf->errors)) != NULL){gfree(str);}
+	freestack(buf->errors);
+	gfree(buf->triv);
+	gfree(buf->off);
+	gfree(buf->kind);
+	gfree(buf->op);
+	gfree(buf);
+	return 0;
+}
+
+// Token Pool
+// the lexer takes buffers from a pool before allocating, and the
+// parser or broadcast hands them back once read, so buffers are
+// reused across parses & never freed by a thread that did not make
+// them. Buffers are handed back onto a lock-free stack, and the lexer
+// takes the whole stack at once when its own list runs out, so
+// neither side waits on the other. Nothing is popped from the stack
+// alone, so a top that was taken & handed back again is harmless.
+// Buffers are emptied as they are taken, so the error messages a
+// lexer made are freed on its thread.
+// A NULL pool allocates & frees instead.
+typedef struct {
+	TokBuf *spare; // list of spare buffers, the lexer's own
+	TokBuf *back; // stack of buffers handed back, by any thread
+} TokPool;
+
+TokPool *inittokpool () {
+	TokPool *pool = gsmalloc(memTok, sizeof (TokPool));
+	if (pool == NULL){return NULL;}
+	pool->spare = NULL;
+	pool->back = NULL;
+	return pool;
+}
+
+int freetokpool (TokPool *pool) {
+	for (TokBuf *buf = pool->back; buf != NULL;){
+		TokBuf *next = buf->next;
+		freetokbuf(buf);
+		buf = next;
+	}
+	while (pool->spare != NULL){
+		TokBuf *buf = pool->spare;
+		pool->spare = buf->next;
+		freetokbuf(buf);
+	}
+	gfree(pool);
+	return 0;
 }
 
-// pops error from an error stack
-Token *poptok (MutexStack *stack) {
-	return mpop(stack);
+// a spare buffer, emptied, or a new one. Only the lexer takes.
+TokBuf *taketokbuf (TokPool *pool, int trivia) {
+	if (pool == NULL){return inittokbuf(trivia);}
+	if (pool->spare == NULL){pool->spare = __atomic_exchange_n(&pool->back, NULL, __ATOMIC_ACQUIRE);}
+	TokBuf *buf = pool->spare;
+	if (buf == NULL || (trivia && buf->triv == NULL)){
+		if (buf != NULL){pool->spare = buf->next; freetokbuf(buf);}
+		return inittokbuf(trivia);
+	}
+	pool->spare = buf->next;
+	char *str;
+	while ((str = pop(buf->errors)) != NULL){gfree(str);}
+	buf->len = 0;
+	buf->src = NULL;
+	buf->next = NULL;
+	return buf;
 }
 
-// pushes error onto an error stack
-int pushtok (MutexStack *stack, Token *tok) {
-	// move token to heap memory
-	Token *token = _copytok(tok);
-	if (token == NULL) {return 1;}
-	return mpush(stack, token);
+// returns buf to pool, from any thread
+int givetokbuf (TokPool *pool, TokBuf *buf) {
+	if (pool == NULL){return freetokbuf(buf);}
+	TokBuf *top = __atomic_load_n(&pool->back, __ATOMIC_RELAXED);
+	do {buf->next = top;}
+	while (!__atomic_compare_exchange_n(&pool->back, &top, buf, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	return 0;
 }
 
-// flusherr pops all the errors and returns an array.
-int resettok (Stack *stack) {
-	return resetstack(stack);
-}
\ No newline at end of file
+// is the buffer ready to be sent?
+int tokbuffull (TokBuf *buf) {return buf->len >= buf->max;}
+
+// token at index i
+Token tokat (TokBuf *buf, int i) {
+	Token t = {.off = buf->off[i], .kind = buf->kind[i]};
+	return t;
+}
+
+// builtin id of token at index i
+int tokop (TokBuf *buf, int i) {return buf->op[i];}
+
+// pushes a token onto a token buffer
+int pushtok (TokBuf *buf, int type, uint32_t off, uint32_t len) {
+	if (tokbuffull(buf) || len > TokLenMax){return 1;}
+	buf->off[buf->len] = off;
+	buf->kind[buf->len] = (uint32_t) (uint8_t) type << 24 | len;
+	buf->op[buf->len] = opNone;
+	buf->len++;
+	return 0;
+}
+
+// records the builtin id of the last token pushed
+void pushop (TokBuf *buf, int op) {buf->op[buf->len - 1] = op;}
+
+// records the trivia before the last token pushed
+void pushtriv (TokBuf *buf, uint32_t len) {
+	if (buf->triv != NULL){buf->triv[buf->len - 1] = len;}
+}
+
+// pushes an error message for the next itemErr token,
+// str may go out of scope so it is copied.
+int pushtokerr (TokBuf *buf, char *str) {
+	size_t size = (strlen(str) + 1) * sizeof (char);
+	char *msg = gsmalloc(memTok, size);
+	if (msg == NULL){return 1;}
+	strlcpy(msg, str, size);
+	return push(buf->errors, msg);
+}
@@ -0,0 +1,144 @@
+#import <pthread.h>
+#import <limits.h> // LONG_MAX
+#import "trace.h" // tracing
+#import "govern.h" // gsmalloc
+#import "cancel.h" // Cancel
+
+// Broadcast
+// a broadcast sends each value pushed to every subscriber, in order.
+// Values sit in a ring of cap slots; each subscriber has its own
+// cursor, and a slot is freed only once the slowest subscriber has
+// passed it, so values are shared, never copied. bpush waits while
+// the ring is full, so a slow subscriber holds the producer back
+// rather than letting values pile up.
+// The subscribers are numbered 0 to nsub - 1 & fixed when the
+// broadcast is made, so none can miss the first values.
+
+// Include guard.
+#ifndef BROADCAST
+#define BROADCAST
+
+// frees a value every subscriber has passed
+typedef void (*castFree) (void *arg, void *v);
+
+typedef struct {
+	void **slot; // ring of values, value n is at n % cap
+	int cap;
+	long head; // values pushed
+	long tail; // values freed
+	long *cursor; // next value each subscriber reads, LONG_MAX when done
+	int nsub;
+	castFree drop; // frees passed values, or NULL
+	void *arg;
+	Cancel *cancel; // hands back nothing once cancelled, or NULL
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} Broadcast;
+
+Broadcast *initbroadcast (int cap, int nsub, castFree drop, void *arg) {
+	Broadcast *bc = gsmalloc(memTok, sizeof (Broadcast));
+	if (bc == NULL){return NULL;}
+	bc->slot = gsmalloc(memTok, cap * sizeof (void *));
+	bc->cursor = gscalloc(memTok, nsub, sizeof (long));
+	if (bc->slot == NULL || bc->cursor == NULL){return NULL;}
+	bc->cap = cap;
+	bc->nsub = nsub;
+	bc->head = 0;
+	bc->tail = 0;
+	bc->drop = drop;
+	bc->arg = arg;
+	bc->cancel = NULL;
+	pthread_mutex_init(&bc->lock, NULL);
+	pthread_cond_init(&bc->cond, NULL);
+	return bc;
+}
+
+// frees values not yet freed
+void _bfreeto (Broadcast *bc, long n) {
+	for (; bc->tail < n; bc->tail++){
+		if (bc->drop != NULL){bc->drop(bc->arg, bc->slot[bc->tail % bc->cap]);}
+	}
+}
+
+int freebroadcast (Broadcast *bc) {
+	_bfreeto(bc, bc->head);
+	pthread_mutex_destroy(&bc->lock);
+	pthread_cond_destroy(&bc->cond);
+	gfree(bc->slot);
+	gfree(bc->cursor);
+	gfree(bc);
+	return 0;
+}
+
+// frees the values every subscriber has passed: each still holds
+// the value before its cursor, which it may be reading.
+void _bpassed (Broadcast *bc) {
+	long min = LONG_MAX;
+	for (int i = 0; i < bc->nsub; i++){
+		long held = bc->cursor[i] == LONG_MAX ? LONG_MAX : bc->cursor[i] - 1;
+		if (held < min){min = held;}
+	}
+	if (min > bc->head){min = bc->head;}
+	if (min <= bc->tail){return;}
+	_bfreeto(bc, min);
+	pthread_cond_broadcast(&bc->cond); // wake bpush
+}
+
+// sends v to every subscriber, waiting while cap values are unfreed,
+// fails once cancelled.
+int bpush (Broadcast *bc, void *v) {
+	if (v == NULL){return 1;}
+	pthread_mutex_lock(&bc->lock);
+	while (bc->head - bc->tail >= bc->cap && !cancelled(bc->cancel)){
+		trace("full", traceBegin, bc->head - bc->tail);
+		pthread_cond_wait(&bc->cond, &bc->lock);
+		trace("full", traceEnd, bc->head - bc->tail);
+	}
+	if (cancelled(bc->cancel)){pthread_mutex_unlock(&bc->lock); return 1;}
+	trace("push", traceInstant, bc->head);
+	bc->slot[bc->head++ % bc->cap] = v;
+	_bpassed(bc); // with no one left to read it
+	pthread_cond_broadcast(&bc->cond);
+	pthread_mutex_unlock(&bc->lock);
+	return 0;
+}
+
+// next value for subscriber sub, passing the last it read,
+// or NULL once cancelled.
+void *bnext (Broadcast *bc, int sub) {
+	pthread_mutex_lock(&bc->lock);
+	long *c = &bc->cursor[sub];
+	while (*c >= bc->head && !cancelled(bc->cancel)){
+		trace("wait", traceBegin, *c);
+		pthread_cond_wait(&bc->cond, &bc->lock);
+		trace("wait", traceEnd, *c);
+	}
+	if (cancelled(bc->cancel)){pthread_mutex_unlock(&bc->lock); return NULL;}
+	void *v = bc->slot[*c % bc->cap];
+	trace("pop", traceInstant, *c);
+	(*c)++;
+	_bpassed(bc);
+	pthread_mutex_unlock(&bc->lock);
+	return v;
+}
+
+// subscriber sub reads no more, passing everything
+void bdone (Broadcast *bc, int sub) {
+	pthread_mutex_lock(&bc->lock);
+	bc->cursor[sub] = LONG_MAX;
+	_bpassed(bc);
+	pthread_mutex_unlock(&bc->lock);
+}
+
+// frees what is left & starts every subscriber over
+int resetbroadcast (Broadcast *bc) {
+	pthread_mutex_lock(&bc->lock);
+	_bfreeto(bc, bc->head);
+	bc->head = 0;
+	bc->tail = 0;
+	for (int i = 0; i < bc->nsub; i++){bc->cursor[i] = 0;}
+	pthread_mutex_unlock(&bc->lock);
+	return 0;
+}
+
+#endif // BROADCAST
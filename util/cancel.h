@@ -0,0 +1,135 @@
+#import <pthread.h>
+#import <time.h> // clock_gettime
+#import <errno.h> // ETIMEDOUT
+#import "trace.h" // tracing
+#import "govern.h" // gmalloc
+
+// Cancellation
+// a run of the lexer & parser is cancelled by cancel, from any
+// thread, or when its deadline passes. The lexer & parser check
+// between states; the channels between threads check before & while
+// they wait, handing back nothing once cancelled, so every thread
+// unwinds within a state of cancel, keeping what it made so far.
+// Waits are woken by cancel through the lock & cond each registers
+// with cancelwatch. The deadline is kept by a thread, as the
+// governor's clock is, so checking is a load.
+
+// Include guard.
+#ifndef CANCEL
+#define CANCEL
+
+#define CancelWatchMax 8 // waits a Cancel wakes
+
+// a wait to wake
+typedef struct {
+	pthread_mutex_t *lock;
+	pthread_cond_t *cond;
+} CancelWatch;
+
+typedef struct {
+	int cancelled;
+	double timeout; // seconds a run may take, 0 for no deadline
+	int done; // run finished, stop the clock
+	int clock; // is the clock running?
+	CancelWatch watch[CancelWatchMax];
+	int nwatch;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t th;
+} Cancel;
+
+Cancel *initcancel () {
+	Cancel *c = gcalloc(1, sizeof (Cancel));
+	if (c == NULL){return NULL;}
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->cond, NULL);
+	return c;
+}
+
+int freecancel (Cancel *c) {
+	pthread_mutex_destroy(&c->lock);
+	pthread_cond_destroy(&c->cond);
+	gfree(c);
+	return 0;
+}
+
+// has the run been cancelled? c may be NULL
+int cancelled (Cancel *c) {return c != NULL && __atomic_load_n(&c->cancelled, __ATOMIC_ACQUIRE);}
+
+// wakes waits on cond, under lock, when cancelled
+int cancelwatch (Cancel *c, pthread_mutex_t *lock, pthread_cond_t *cond) {
+	if (c == NULL){return 0;}
+	pthread_mutex_lock(&c->lock);
+	int full = c->nwatch >= CancelWatchMax;
+	if (!full){
+		CancelWatch w = {.lock = lock, .cond = cond};
+		c->watch[c->nwatch++] = w;
+	}
+	pthread_mutex_unlock(&c->lock);
+	return full;
+}
+
+void cancelunwatch (Cancel *c, pthread_cond_t *cond) {
+	if (c == NULL){return;}
+	pthread_mutex_lock(&c->lock);
+	for (int i = 0; i < c->nwatch; i++){
+		if (c->watch[i].cond == cond){c->watch[i--] = c->watch[--c->nwatch];}
+	}
+	pthread_mutex_unlock(&c->lock);
+}
+
+// cancels the run, waking every wait. A wait checks under its lock,
+// which is taken here after setting the flag, so none is missed.
+void cancel (Cancel *c) {
+	pthread_mutex_lock(&c->lock);
+	__atomic_store_n(&c->cancelled, 1, __ATOMIC_RELEASE);
+	for (int i = 0; i < c->nwatch; i++){
+		pthread_mutex_lock(c->watch[i].lock);
+		pthread_cond_broadcast(c->watch[i].cond);
+		pthread_mutex_unlock(c->watch[i].lock);
+	}
+	pthread_mutex_unlock(&c->lock);
+}
+
+// cancels the run if it is not done by its deadline
+void *_cancelclock (void *v) {
+	Cancel *c = (Cancel *) v;
+	tracename("deadline");
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	long ns = ts.tv_nsec + (long) ((c->timeout - (long) c->timeout) * 1e9);
+	ts.tv_sec += (long) c->timeout + ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+
+	pthread_mutex_lock(&c->lock);
+	int err = 0;
+	while (!c->done && err != ETIMEDOUT){
+		err = pthread_cond_timedwait(&c->cond, &c->lock, &ts);
+	}
+	int done = c->done;
+	pthread_mutex_unlock(&c->lock);
+	if (!done){cancel(c);}
+	return NULL;
+}
+
+// starts a run, and its clock if it has a deadline
+int cancelstart (Cancel *c) {
+	c->done = 0;
+	c->clock = c->timeout > 0;
+	if (!c->clock){return 0;}
+	return pthread_create(&c->th, NULL, _cancelclock, c);
+}
+
+// ends a run, stopping its clock
+void cancelstop (Cancel *c) {
+	pthread_mutex_lock(&c->lock);
+	c->done = 1;
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+	if (c->clock){pthread_join(c->th, NULL); c->clock = 0;}
+}
+
+// readies the next run
+void resetcancel (Cancel *c) {__atomic_store_n(&c->cancelled, 0, __ATOMIC_RELEASE);}
+
+#endif // CANCEL
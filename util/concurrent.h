@@ -1,4 +1,8 @@
 #import <pthread.h>
+#import <string.h> // memmove
+#import "trace.h" // tracing
+#import "govern.h" // gsmalloc
+#import "cancel.h" // Cancel
 
 // Simple functions for concurrently working with recourses
 // when using pthreads & Basilisk
@@ -13,24 +17,28 @@ typedef struct {
 	int len; // length of stack
 	int max;
 	int index; // read from base length
+	int cap; // most unread values before mpush waits, 0 for no limit
+	Cancel *cancel; // hands back nothing once cancelled, or NULL
 	pthread_mutex_t *lock;
 	pthread_cond_t *cond;
 } MutexStack;
 
 MutexStack *initmstack() {
 	// allocate ErrorStack on heap memory
-	MutexStack *stack = (MutexStack *) malloc(sizeof (MutexStack));
+	MutexStack *stack = (MutexStack *) gsmalloc(memTok, sizeof (MutexStack));
 	if (stack == NULL){return NULL;}
 
 	stack->stack = NULL;
 	stack->len = 0;
 	stack->max = 0;
 	stack->index = 0;
+	stack->cap = 0;
+	stack->cancel = NULL;
 
-	stack->lock = malloc(sizeof (pthread_mutex_t));
+	stack->lock = gsmalloc(memTok, sizeof (pthread_mutex_t));
 	if (stack->lock == NULL){return NULL;}
 
-	stack->cond = malloc(sizeof (pthread_cond_t));
+	stack->cond = gsmalloc(memTok, sizeof (pthread_cond_t));
 	if (stack->cond == NULL){return NULL;}
 
 	pthread_cond_init(stack->cond, NULL);
@@ -40,36 +48,45 @@ MutexStack *initmstack() {
 
 int freemstack(MutexStack *stack) {
 	pthread_mutex_destroy(stack->lock);
-	free(stack->stack);
-	free(stack);
+	pthread_cond_destroy(stack->cond);
+	gfree(stack->lock);
+	gfree(stack->cond);
+	gfree(stack->stack);
+	gfree(stack);
 	return 0;
 }
 
 int resizemstack (MutexStack *stack) {
 	int grow, shrink;
 	grow = stack == NULL || stack->len >= stack->max;
-	shrink = (stack->max - stack->len) > StackBuf;
+	shrink = stack->cap == 0 && stack->max > StackBuf && stack->len < stack->max / 4; // capped stacks stay small
 	if (!grow && !shrink) {return 0;}
-	
-	// reallocate len+buf # of Error pointer positions
-	int buff;
-	if (grow){buff = StackBuf;}
-	else{buff = 0;}
-	size_t size = (stack->len + buff) * sizeof (void *);
-	stack->stack = (void **) realloc(stack->stack, size);
-	if (stack->stack == NULL){free(stack->stack); return 1;}
-	stack->max = size / sizeof (void *); // new max is len
+
+	// grows & shrinks geometrically, like resizestack
+	int max;
+	if (grow){max = stack->max > 0 ? stack->max * 2 : StackBuf;}
+	else{max = stack->max / 2;}
+	void **v = (void **) gsrealloc(memTok, stack->stack, max * sizeof (void *));
+	if (v == NULL){return 1;}
+	stack->stack = v;
+	stack->max = max;
 	return 0;
 }
 
-// Should be called from thread not calling mpush
+// Should be called from thread not calling mpush,
+// returns NULL once cancelled.
 void *mnext (MutexStack *stack) {
 	pthread_mutex_lock(stack->lock);
-	if (stack->index >= stack->len){
+	while (stack->index >= stack->len && !cancelled(stack->cancel)){
+		trace("wait", traceBegin, stack->index);
 		pthread_cond_wait(stack->cond, stack->lock);
+		trace("wait", traceEnd, stack->index);
 	}
+	if (cancelled(stack->cancel)){pthread_mutex_unlock(stack->lock); return NULL;}
 	void *v = stack->stack[stack->index];
+	trace("pop", traceInstant, stack->index);
 	stack->index++;
+	if (stack->cap > 0){pthread_cond_broadcast(stack->cond);} // wake mpush
 	pthread_mutex_unlock(stack->lock);
 	return v;
 }
@@ -77,9 +94,20 @@ void *mnext (MutexStack *stack) {
 // Should be called from thread not calling mpush
 int mbackup (MutexStack *stack) {
 	pthread_mutex_lock(stack->lock);
-	stack->index--;
+	if (stack->index > 0){stack->index--;}
+	int i = stack->index;
 	pthread_mutex_unlock(stack->lock);
-	return stack->index;
+	return i;
+}
+
+// drops read values but the last, so mbackup still works,
+// keeping the stack as long as the values unread.
+void _mcompact (MutexStack *stack) {
+	if (stack->index <= 1){return;}
+	int n = stack->index - 1;
+	memmove(stack->stack, &stack->stack[n], (stack->len - n) * sizeof (void *));
+	stack->len -= n;
+	stack->index -= n;
 }
 
 // pops error from an error stack
@@ -99,28 +127,42 @@ void *mpop (MutexStack *stack) {
 	return stack->stack[stack->len]; // pass reference to Error
 }
 
-// pushes error onto an error stack
+// pushes error onto an error stack,
+// waits while cap values are unread, fails once cancelled.
 int mpush (MutexStack *stack, void *v) {
+	if (v == NULL) {return 1;}
 	pthread_mutex_lock(stack->lock);
-	pthread_cond_broadcast(stack->cond);
+	while (stack->cap > 0 && stack->len - stack->index >= stack->cap && !cancelled(stack->cancel)){
+		trace("full", traceBegin, stack->len - stack->index);
+		pthread_cond_wait(stack->cond, stack->lock);
+		trace("full", traceEnd, stack->len - stack->index);
+	}
+	if (cancelled(stack->cancel)){pthread_mutex_unlock(stack->lock); return 1;}
+	trace("push", traceInstant, stack->len);
+	if (stack->len >= stack->max){_mcompact(stack);}
 	// resize stack
-	if(resizemstack(stack)){return 1;}
-
-	stack->len++; // increment len
-	if (stack->len <= 0){return 1;}
-
-	if (v == NULL) {return 1;}
+	if(stack->len >= stack->max && resizemstack(stack)){pthread_mutex_unlock(stack->lock); return 1;}
 
 	// Push to created space on stack
-	stack->stack[stack->len - 1] = v;
+	stack->stack[stack->len++] = v;
+	pthread_cond_broadcast(stack->cond);
 	pthread_mutex_unlock(stack->lock);
 	return 0;
 }
 
+// unread values, after the reader is done
+void *mleft (MutexStack *stack) {
+	pthread_mutex_lock(stack->lock);
+	void *v = stack->index < stack->len ? stack->stack[stack->index++] : NULL;
+	pthread_mutex_unlock(stack->lock);
+	return v;
+}
+
 // "dumps" all values
 int resetmstack(MutexStack *stack) {
 	pthread_mutex_lock(stack->lock);
 	stack->len = 0; // zero errors in stack
+	stack->index = 0;
 	pthread_mutex_unlock(stack->lock);
 	return 0;
 }
@@ -40,6 +40,7 @@ void _gerr (const char *str) {
 	len = strlcat(msg, "\n", len + (2 * sizeof (char))); // add newline
 	fwrite(msg, len, sizeof (char), stderr);
 	fflush(stderr);
+	free(msg);
 }
 
 // function used to do a simple sprintf and call to _gerr.
@@ -102,23 +103,25 @@ int _diag (Error *err, FILE *stream) {
 	char arrow[] = "\033[1m\033[32m^\033[0m\n";
 	char undln[] = "\033[1m\033[32m~";
 	int i;
-	// copy content to local string
-	i = strlcpy(str, err->read, *err->rdlen + 1);
+	// copy content to local string, only as far as the token goes:
+	// read runs on to the end of the source.
+	i = *err->rdlen < 100 ? *err->rdlen : 100;
+	memcpy(str, err->read, i);
 	// append newline, only if not already appended
-	if (err->read[*err->rdlen - 1] != '\n'){
-		i = strlcat(str, "\n", (*err->rdlen + 2) * sizeof (char));
-	}
+	if (i == 0 || str[i - 1] != '\n'){str[i++] = '\n';}
+	str[i] = '\0';
 	int tabs = counttabs(err->read, *err->rdlen); // tab count
 	int j;
+	int max = sizeof str - sizeof arrow - sizeof undln; // long lines are marked short
 	if (err->past > 0){err->past--;} // only the number of undls
 	// fills tabs
-	for (j = 0; j < tabs; j++) {
+	for (j = 0; j < tabs && i < max; j++) {
 		str[i] = '\t'; i+= sizeof (char);}
 	// fills spaces
-	for (; j < (err->ch - (err->past + 1)); j++) {
+	for (; j < (err->ch - (err->past + 1)) && i < max; j++) {
 		str[i] = ' '; i += sizeof (char);}
 	// fills undls
-	for (; j < (err->ch - 1); j++){
+	for (; j < (err->ch - 1) && i < max; j++){
 		strlcpy(&str[i], undln, sizeof undln);
 		i += sizeof undln / sizeof (char);}
 	strlcpy(&str[i], arrow, sizeof arrow);
@@ -129,8 +132,9 @@ int _diag (Error *err, FILE *stream) {
 
 // configurable error
 int _err (Error *err, FILE *stream) {
-	char strg[100];
-	int i = sprintf(strg, "\033[1m%s:%d:%d \033[%dm%s:\033[0m\033[%dm %s\033[0m\n", err->name, err->line, err->ch, err->c, err->err, err->b, err->str);
+	char strg[300];
+	int i = snprintf(strg, sizeof strg, "\033[1m%s:%d:%d \033[%dm%s:\033[0m\033[%dm %s\033[0m\n", err->name, err->line, err->ch, err->c, err->err, err->b, err->str);
+	if (i >= (int) sizeof strg){i = sizeof strg - 1;}
 	i = fwrite(strg, i, sizeof (char), stream);
 	if (err->diag){_diag(err, stream);} // optional diagnostic
 	return i;
@@ -0,0 +1,196 @@
+#import <stdio.h> // snprintf
+#import <stdlib.h> // malloc
+#import <string.h> // memset
+#import <pthread.h>
+#import <time.h> // clock_gettime
+#import <errno.h> // ETIMEDOUT
+#import <stdint.h> // uint64_t
+
+// from gerr.h, which needs Stack and so cannot be imported here
+void gterr (const char *str);
+void gnote (const char *str);
+
+// Resource Governor
+// every allocation of the lexer, token stack, parser, AST and checker goes
+// through gmalloc & co., which charge it to a stage of the governor
+// of the compilation it belongs to. Going over the memory budget,
+// or taking longer than the time budget, is a fatal error.
+// Each thread sets its governor and default stage with govern,
+// allocations made for another stage use the gs- functions.
+// A header before each allocation records its size, stage and
+// governor, so it can be freed from any thread.
+
+// Include guard.
+#ifndef GOVERN
+#define GOVERN
+
+// stages
+#define MemStages 5
+const int memLex = 0;
+const int memTok = 1;
+const int memParse = 2;
+const int memAst = 3;
+const int memCheck = 4;
+const char *memStageName[MemStages] = {"lex", "tok", "parse", "ast", "check"};
+
+typedef struct {
+	long used[MemStages]; // bytes held by each stage
+	long peak[MemStages]; // most bytes each stage held
+	long total; // bytes held by all stages
+	long peaktotal;
+	long max; // memory budget, 0 for none
+	double maxtime; // time budget in seconds, 0 for none
+	int done; // compilation finished, stop the clock
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t th;
+} Governor;
+
+// header of each allocation, keeping it 16 byte aligned
+typedef struct {
+	Governor *gov;
+	uint64_t size : 56; // size of allocation
+	uint64_t stage : 8;
+} GovHead;
+
+__thread Governor *governor = NULL; // governor of this thread
+__thread int memStage = 0; // stage allocations are charged to
+
+// sets this thread's governor & stage
+void govern (Governor *gov, int stage) {
+	governor = gov;
+	memStage = stage;
+}
+
+// raises peak to n if it is higher
+void _govpeak (long *peak, long n) {
+	long p = __atomic_load_n(peak, __ATOMIC_RELAXED);
+	while (n > p && !__atomic_compare_exchange_n(peak, &p, n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){}
+}
+
+// charges n bytes (negative to credit) to stage
+void _govcharge (Governor *gov, int stage, long n) {
+	if (gov == NULL){return;}
+	long used = __atomic_add_fetch(&gov->used[stage], n, __ATOMIC_RELAXED);
+	long total = __atomic_add_fetch(&gov->total, n, __ATOMIC_RELAXED);
+	if (n <= 0){return;}
+	_govpeak(&gov->peak[stage], used);
+	_govpeak(&gov->peaktotal, total);
+	if (gov->max > 0 && total > gov->max){
+		char str[100];
+		snprintf(str, sizeof str, "memory budget of %ld bytes exceeded in %s", gov->max, memStageName[stage]);
+		gterr(str);
+	}
+}
+
+// allocates for stage
+void *gsmalloc (int stage, size_t size) {
+	GovHead *h = malloc(sizeof (GovHead) + size);
+	if (h == NULL){return NULL;}
+	h->gov = governor;
+	h->size = size;
+	h->stage = stage;
+	_govcharge(h->gov, h->stage, size);
+	return h + 1;
+}
+
+void *gscalloc (int stage, size_t n, size_t size) {
+	void *v = gsmalloc(stage, n * size);
+	if (v != NULL){memset(v, 0, n * size);}
+	return v;
+}
+
+// reallocates, keeping the stage & governor v was allocated with
+void *gsrealloc (int stage, void *v, size_t size) {
+	if (v == NULL){return gsmalloc(stage, size);}
+	GovHead *h = (GovHead *) v - 1;
+	long last = h->size;
+	GovHead *n = realloc(h, sizeof (GovHead) + size);
+	if (n == NULL){return NULL;}
+	n->size = size;
+	_govcharge(n->gov, n->stage, (long) size - last);
+	return n + 1;
+}
+
+void gfree (void *v) {
+	if (v == NULL){return;}
+	GovHead *h = (GovHead *) v - 1;
+	_govcharge(h->gov, h->stage, -(long) h->size);
+	free(h);
+}
+
+// allocating for this thread's stage
+void *gmalloc (size_t size) {return gsmalloc(memStage, size);}
+void *gcalloc (size_t n, size_t size) {return gscalloc(memStage, n, size);}
+void *grealloc (void *v, size_t size) {return gsrealloc(memStage, v, size);}
+
+// Time
+// the time budget is kept by a thread that waits for the
+// compilation to be done, and gives up on it if it is not.
+
+void *_govclock (void *v) {
+	Governor *gov = (Governor *) v;
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	long ns = ts.tv_nsec + (long) ((gov->maxtime - (long) gov->maxtime) * 1e9);
+	ts.tv_sec += (long) gov->maxtime + ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+
+	pthread_mutex_lock(&gov->lock);
+	int err = 0;
+	while (!gov->done && err != ETIMEDOUT){
+		err = pthread_cond_timedwait(&gov->cond, &gov->lock, &ts);
+	}
+	int done = gov->done;
+	pthread_mutex_unlock(&gov->lock);
+	if (!done){
+		char str[100];
+		snprintf(str, sizeof str, "time budget of %gs exceeded", gov->maxtime);
+		gterr(str);
+	}
+	return NULL;
+}
+
+// starts the clock, if there is a time budget
+int govstart (Governor *gov) {
+	pthread_mutex_init(&gov->lock, NULL);
+	pthread_cond_init(&gov->cond, NULL);
+	if (gov->maxtime <= 0){return 0;}
+	return pthread_create(&gov->th, NULL, _govclock, gov);
+}
+
+// stops the clock
+int govdone (Governor *gov) {
+	pthread_mutex_lock(&gov->lock);
+	gov->done = 1;
+	pthread_cond_broadcast(&gov->cond);
+	pthread_mutex_unlock(&gov->lock);
+	if (gov->maxtime > 0){pthread_join(gov->th, NULL);}
+	pthread_mutex_destroy(&gov->lock);
+	pthread_cond_destroy(&gov->cond);
+	return 0;
+}
+
+// writes n bytes in human units
+void _govbytes (char *str, size_t size, long n) {
+	const char *unit[] = {"B", "KiB", "MiB", "GiB"};
+	double d = n;
+	int u = 0;
+	for (; d >= 1024 && u < 3; u++){d /= 1024;}
+	snprintf(str, size, "%.1f%s", d, unit[u]);
+}
+
+// notes the peak memory of each stage
+void govnote (Governor *gov) {
+	char str[200], b[20];
+	int i = snprintf(str, sizeof str, "peak memory:");
+	for (int s = 0; s < MemStages; s++){
+		_govbytes(b, sizeof b, gov->peak[s]);
+		i += snprintf(&str[i], sizeof str - i, " %s %s,", memStageName[s], b);
+	}
+	_govbytes(b, sizeof b, gov->peaktotal);
+	snprintf(&str[i], sizeof str - i, " total %s.", b);
+	gnote(str);
+}
+
+#endif // GOVERN
@@ -0,0 +1,93 @@
+#import <stdint.h> // uint64_t
+#import <stddef.h> // size_t
+#import <string.h> // memset
+#import "govern.h" // gscalloc
+
+// Hashing
+// fnv-1a, shared by anything that needs a quick, stable hash.
+
+const uint64_t FnvBasis = 14695981039346656037ULL;
+
+// fnv-1a over n bytes, continuing from h
+uint64_t fnv (uint64_t h, const void *v, size_t n) {
+	const unsigned char *c = v;
+	for (size_t i = 0; i < n; i++){h = (h ^ c[i]) * 1099511628211ULL;}
+	return h;
+}
+
+// Hash Tables
+// an open addressed set of entries its user keeps in an array of
+// their own, probing linearly & doubling at half full. A slot holds
+// an entry's hash & its index in that array, so the array may move.
+// Keys are compared by the user, by eq, only when hashes match.
+// Adding is hashroom, then hashfind, then hashput on the empty slot.
+
+typedef struct {
+	uint64_t h;
+	long v; // index of the entry + 1, 0 for an empty slot
+} HashSlot;
+
+typedef struct {
+	HashSlot *slot;
+	long len; // entries
+	long max; // slots, a power of two
+	int stage; // governor stage slots are charged to
+} HashTable;
+
+// is entry i the key? ctx is the user's, passed on by hashfind
+typedef int (*hashEq) (void *ctx, long i, const void *key);
+
+// a table of max slots, a power of two
+int inithash (HashTable *t, long max, int stage) {
+	t->slot = gscalloc(stage, max, sizeof (HashSlot));
+	t->len = 0;
+	t->max = max;
+	t->stage = stage;
+	return t->slot == NULL;
+}
+
+void freehash (HashTable *t) {gfree(t->slot); t->slot = NULL;}
+
+// empties the table, keeping its slots
+void resethash (HashTable *t) {
+	memset(t->slot, 0, t->max * sizeof (HashSlot));
+	t->len = 0;
+}
+
+// makes room for one more entry, doubling the slots at half full
+int hashroom (HashTable *t) {
+	if (2 * (t->len + 1) <= t->max){return 0;}
+	long max = t->max * 2;
+	HashSlot *slot = gscalloc(t->stage, max, sizeof (HashSlot));
+	if (slot == NULL){return 1;}
+	for (long i = 0; i < t->max; i++){
+		if (t->slot[i].v == 0){continue;}
+		long j = t->slot[i].h & (max - 1);
+		while (slot[j].v != 0){j = (j + 1) & (max - 1);}
+		slot[j] = t->slot[i];
+	}
+	gfree(t->slot);
+	t->slot = slot;
+	t->max = max;
+	return 0;
+}
+
+// slot of the entry equal to key, whose hash is h, or the empty
+// slot it would go in
+long hashfind (HashTable *t, uint64_t h, hashEq eq, void *ctx, const void *key) {
+	long mask = t->max - 1;
+	for (long i = h & mask;; i = (i + 1) & mask){
+		HashSlot *s = &t->slot[i];
+		if (s->v == 0 || (s->h == h && eq(ctx, s->v - 1, key))){return i;}
+	}
+}
+
+// index of the entry in slot s, -1 if it is empty
+long hashat (HashTable *t, long s) {return t->slot[s].v - 1;}
+
+// puts entry i, whose hash is h, in slot s, replacing what was there
+void hashput (HashTable *t, long s, uint64_t h, long i) {
+	if (t->slot[s].v == 0){t->len++;}
+	HashSlot n = {.h = h, .v = i + 1};
+	t->slot[s] = n;
+}
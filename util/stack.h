@@ -1,3 +1,5 @@
+#import "govern.h" // gmalloc
+
 // Consolidated stack management for any type.
 
 // Stack
@@ -5,41 +7,44 @@ typedef struct {
 	void **stack; // stack of void pointers.
 	int len; // length of stack
 	int max;
+	int keep; // never shrink, for pools that refill
 } Stack;
 
 const int StackBuf = 5;
 
 Stack *initstack() {
 	// allocate ErrorStack on heap memory
-	Stack *stack = (Stack *) malloc(sizeof (Stack));
+	Stack *stack = (Stack *) gmalloc(sizeof (Stack));
 	if (stack == NULL){return NULL;}
 
 	stack->stack = NULL;
 	stack->len = 0;
 	stack->max = 0;
+	stack->keep = 0;
 	return stack;
 }
 
 int freestack(Stack *stack) {
-	free(stack->stack);
-	free(stack);
+	gfree(stack->stack);
+	gfree(stack);
 	return 0;
 }
 
 int resizestack (Stack *stack) {
 	int grow, shrink;
 	grow = stack == NULL || stack->len >= stack->max;
-	shrink = (stack->max - stack->len) > StackBuf;
+	shrink = !stack->keep && stack->max > StackBuf && stack->len < stack->max / 4;
 	if (!grow && !shrink) {return 0;}
-	
-	// reallocate len+buf # of Error pointer positions
-	int buff;
-	if (grow){buff = StackBuf;}
-	else{buff = 0;}
-	size_t size = (stack->len + buff) * sizeof (void *);
-	stack->stack = (void **) realloc(stack->stack, size);
-	if (stack->stack == NULL){free(stack->stack); return 1;}
-	stack->max = size / sizeof (void *); // new max is len
+
+	// double when full & halve when a quarter full, so pushes
+	// and pops stay amortized constant time however deep it gets.
+	int max;
+	if (grow){max = stack->max > 0 ? stack->max * 2 : StackBuf;}
+	else{max = stack->max / 2;}
+	void **v = (void **) grealloc(stack->stack, max * sizeof (void *));
+	if (v == NULL){return 1;}
+	stack->stack = v;
+	stack->max = max;
 	return 0;
 }
 
@@ -60,7 +65,7 @@ void *pop (Stack *stack) {
 int push (Stack *stack, void *v) {
 
 	// resize stack
-	if(resizestack(stack)){return 1;}
+	if(stack->len >= stack->max && resizestack(stack)){return 1;} // only grows, pops shrink
 
 	stack->len++; // increment len
 	if (stack->len <= 0){return 1;}
@@ -1,3 +1,6 @@
+#import "trace.h" // tracing
+#import "cancel.h" // Cancel
+
 // Unified state machine structures and functions
 
 // state function signature
@@ -5,13 +8,18 @@ typedef int (*stateFun) (void *v);
 
 // State Machine
 // the state machine takes an array of type stateFun functions,
-// which it calls until one returns -1, which kills the function.
+// which it calls until one returns -1, which kills the function,
+// or until c is cancelled, returning 1. c may be NULL.
 
 // State machine
-int state (stateFun state[], void *v) {
+int state (stateFun state[], void *v, Cancel *c) {
 	
 	for (int f = 0; f != -1;) {
-		f = state[f](v);
+		if (cancelled(c)){return 1;}
+		trace("state", traceBegin, f);
+		int n = state[f](v);
+		trace("state", traceEnd, f);
+		f = n;
 	}
 
 	return 0;
@@ -0,0 +1,135 @@
+#import <stdio.h> // fprintf
+#import <stdlib.h> // calloc
+#import <stdint.h> // uint64_t
+#import <time.h> // clock_gettime
+#if defined(__x86_64__) || defined(__i386__)
+#import <x86intrin.h> // __rdtsc
+#endif
+
+// Tracing
+// events are recorded into a ring per thread, stamped with the
+// cycle counter, and dumped as a Chrome trace (chrome://tracing or
+// ui.perfetto.dev) when the program is done.
+// When tracing is off each event costs one branch on tracing,
+// building with -DNOTRACE removes even that.
+
+// Include guard.
+#ifndef TRACE
+#define TRACE
+
+// event phases
+const char traceBegin = 'B';
+const char traceEnd = 'E';
+const char traceInstant = 'i';
+
+typedef struct {
+	uint64_t ts; // cycle count
+	const char *name;
+	int arg;
+	char ph; // phase
+} TraceEvent;
+
+// ring of events, only written by its own thread
+typedef struct TraceRing {
+	TraceEvent *ev;
+	uint64_t len; // events written, the ring keeps the last TraceRingLen
+	const char *name; // name of thread
+	int tid;
+	struct TraceRing *next; // next registered ring
+} TraceRing;
+
+#define TraceRingLen (1 << 16)
+
+int tracing = 0; // is tracing on?
+TraceRing *traceRings = NULL; // every thread's ring
+int traceTids = 0;
+__thread TraceRing *traceRing = NULL; // this thread's ring
+uint64_t traceTsc; // cycles at tracestart
+uint64_t traceNs; // time at tracestart
+
+uint64_t _tracens () {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// cycle counter, or nanoseconds where there is none
+uint64_t _tracetsc () {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return _tracens();
+#endif
+}
+
+// this thread's ring, registered on first use
+TraceRing *_tracering () {
+	if (traceRing != NULL){return traceRing;}
+	TraceRing *r = calloc(1, sizeof (TraceRing));
+	if (r == NULL){return NULL;}
+	r->ev = malloc(TraceRingLen * sizeof (TraceEvent));
+	if (r->ev == NULL){free(r); return NULL;}
+	r->tid = __atomic_add_fetch(&traceTids, 1, __ATOMIC_RELAXED);
+	r->next = __atomic_load_n(&traceRings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&traceRings, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){}
+	traceRing = r;
+	return r;
+}
+
+void _trace (const char *name, char ph, int arg) {
+	TraceRing *r = _tracering();
+	if (r == NULL){return;}
+	TraceEvent *e = &r->ev[r->len++ & (TraceRingLen - 1)];
+	e->ts = _tracetsc();
+	e->name = name;
+	e->arg = arg;
+	e->ph = ph;
+}
+
+// names this thread in the trace
+void _tracename (const char *name) {
+	TraceRing *r = _tracering();
+	if (r != NULL){r->name = name;}
+}
+
+#ifdef NOTRACE
+#define trace(name, ph, arg) do {} while (0)
+#define tracename(name) do {} while (0)
+#else
+#define trace(name, ph, arg) do {if (__builtin_expect(tracing, 0)){_trace(name, ph, arg);}} while (0)
+#define tracename(name) do {if (__builtin_expect(tracing, 0)){_tracename(name);}} while (0)
+#endif
+
+// turns tracing on
+void tracestart () {
+	traceNs = _tracens();
+	traceTsc = _tracetsc();
+	tracing = 1;
+}
+
+// writes every ring to stream as a Chrome trace,
+// the threads recording must be done.
+int tracedump (FILE *stream) {
+	tracing = 0;
+	double scale = (double) (_tracens() - traceNs) / (_tracetsc() - traceTsc + 1);
+	fprintf(stream, "{\"traceEvents\":[\n");
+	int first = 1;
+	TraceRing *r = __atomic_load_n(&traceRings, __ATOMIC_ACQUIRE);
+	for (; r != NULL; r = r->next){
+		if (r->name != NULL){
+			fprintf(stream, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", r->tid, r->name);
+			first = 0;
+		}
+		uint64_t i = r->len > TraceRingLen ? r->len - TraceRingLen : 0;
+		for (; i < r->len; i++){
+			TraceEvent *e = &r->ev[i & (TraceRingLen - 1)];
+			double us = (e->ts - traceTsc) * scale / 1000;
+			fprintf(stream, "%s{\"ph\":\"%c\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"n\":%d}%s}", first ? "" : ",\n", e->ph, e->name, r->tid, us, e->arg, e->ph == traceInstant ? ",\"s\":\"t\"" : "");
+			first = 0;
+		}
+	}
+	fprintf(stream, "\n]}\n");
+	return ferror(stream);
+}
+
+#endif // TRACE
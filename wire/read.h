@@ -0,0 +1,144 @@
+#import <stdlib.h> // malloc
+#import <string.h> // memcmp
+#import <unistd.h> // read
+#import <errno.h> // EINTR
+#import "wire.h" // wire format
+
+// Wire Reader
+// reads a stream written by --emit=tokens or --emit=ast, for other
+// programs, on its own: it needs nothing else of basilisk. Records
+// are read into one buffer & handed back in place, so tokens & nodes
+// are not copied again or decoded. The source is: each wireSrc record
+// is copied into one buffer, so the text of a token or node is a
+// slice of it.
+//
+//	WireReader *r = initwreader(0);
+//	WireRec *rec;
+//	while ((rec = wnext(r)) != NULL){
+//		int n;
+//		const WireTok *t = wtoks(rec, &n);
+//		for (int i = 0; i < n; i++){use(wtext(r, t[i].off), wirelen(t[i].kind), t[i].sym);}
+//	}
+//	freewreader(r);
+
+// Include guard.
+#ifndef WIREREAD
+#define WIREREAD
+
+const int WireReadLen = 4 << 20; // larger than a record, usually
+
+typedef struct {
+	int fd;
+	char *buf; // records read
+	long len, max;
+	long at; // offset of the next record in buf
+	char *src; // source of the wireSrc records so far
+	long srclen, srcmax;
+	uint32_t what; // wireTokens or wireAst
+	int end; // was wireEnd read?
+	int err;
+} WireReader;
+
+// round up to a record boundary
+long _walign (long n) {return (n + 3) & ~3L;}
+
+// reads until n bytes are in buf from at, nonzero if the stream ends first
+int _wfill (WireReader *r, long n) {
+	if (r->len - r->at >= n){return 0;}
+	memmove(r->buf, &r->buf[r->at], r->len - r->at); // records before at are done with
+	r->len -= r->at;
+	r->at = 0;
+	if (n > r->max){
+		long max = r->max;
+		while (max < n){max *= 2;}
+		char *b = realloc(r->buf, max);
+		if (b == NULL){r->err = 1; return 1;}
+		r->buf = b;
+		r->max = max;
+	}
+	while (r->len < n){
+		ssize_t k = read(r->fd, &r->buf[r->len], r->max - r->len);
+		if (k < 0 && errno == EINTR){continue;}
+		if (k <= 0){r->err = k < 0; return 1;}
+		r->len += k;
+	}
+	return 0;
+}
+
+void freewreader (WireReader *r) {
+	free(r->buf);
+	free(r->src);
+	free(r);
+}
+
+// a reader of the stream on fd, NULL if it is not one
+WireReader *initwreader (int fd) {
+	WireReader *r = calloc(1, sizeof (WireReader));
+	if (r == NULL){return NULL;}
+	r->fd = fd;
+	r->max = WireReadLen;
+	r->buf = malloc(r->max);
+	if (r->buf == NULL || _wfill(r, sizeof (WireHead))){freewreader(r); return NULL;}
+	WireHead h;
+	memcpy(&h, r->buf, sizeof h);
+	if (memcmp(h.magic, "BSKW", 4) != 0 || h.version != WireVersion){freewreader(r); return NULL;}
+	r->what = h.what;
+	r->at = sizeof h;
+	return r;
+}
+
+// appends the source of a wireSrc record
+int _wsrc (WireReader *r, WireRec *rec) {
+	if (r->srclen + rec->len > r->srcmax){
+		long max = r->srcmax > 0 ? r->srcmax : WireReadLen;
+		while (max < r->srclen + rec->len){max *= 2;}
+		char *s = realloc(r->src, max);
+		if (s == NULL){return 1;}
+		r->src = s;
+		r->srcmax = max;
+	}
+	memcpy(&r->src[r->srclen], rec + 1, rec->len);
+	r->srclen += rec->len;
+	return 0;
+}
+
+// the next record, in place until the next call, or NULL after
+// wireEnd, if the stream was cut short or on error. The source of
+// wireSrc records is kept, for wtext.
+WireRec *wnext (WireReader *r) {
+	if (r->end || r->err){return NULL;}
+	if (_wfill(r, sizeof (WireRec))){return NULL;}
+	WireRec *rec = (WireRec *) &r->buf[r->at];
+	long n = sizeof (WireRec) + _walign(rec->len);
+	if (_wfill(r, n)){return NULL;}
+	rec = (WireRec *) &r->buf[r->at]; // moved
+	r->at += n;
+	if (rec->type == wireSrc && _wsrc(r, rec)){r->err = 1; return NULL;}
+	if (rec->type == wireEnd){r->end = 1;}
+	return rec;
+}
+
+// tokens of a wireTok record, *n of them, or NULL if it is not one
+const WireTok *wtoks (WireRec *rec, int *n) {
+	*n = rec->type == wireTok ? rec->len / sizeof (WireTok) : 0;
+	return *n > 0 ? (const WireTok *) (rec + 1) : NULL;
+}
+
+// nodes of a wireNode record, *n of them, or NULL if it is not one
+const WireNode *wnodes (WireRec *rec, int *n) {
+	*n = rec->type == wireNode ? rec->len / sizeof (WireNode) : 0;
+	return *n > 0 ? (const WireNode *) (rec + 1) : NULL;
+}
+
+// text at off in the source, valid until the next wnext
+const char *wtext (WireReader *r, uint32_t off) {return &r->src[off];}
+
+// flags of a wireEnd record, -1 for other records
+int wendflags (WireRec *rec) {
+	if (rec->type != wireEnd || rec->len < sizeof (uint32_t)){return -1;}
+	uint32_t flags;
+	memcpy(&flags, rec + 1, sizeof flags);
+	return flags;
+}
+
+#endif // WIREREAD
@@ -0,0 +1,79 @@
+#import <stdint.h> // uint32_t
+
+// Wire Format
+// --emit=tokens & --emit=ast stream the tokens or the tree to other
+// programs, so they need not lex again. A stream is a WireHead, then
+// records: a WireRec followed by len bytes, padded to 4, in the byte
+// order of the writer. Nothing in it is a pointer.
+// wireSrc records carry the source, in order, so the offsets in the
+// records after them are offsets into all the source so far.
+// wireTok records are arrays of WireTok, wireNode records arrays of
+// WireNode: each top-level form in pre-order, a node followed by its
+// nsub subtrees. An array may go on in the next record of its type,
+// the nodes of a form too. wireEnd is the last record.
+
+// Include guard.
+#ifndef WIRE
+#define WIRE
+
+// what a stream holds
+const int wireTokens = 1;
+const int wireAst = 2;
+
+// record types
+const uint32_t wireSrc = 1;
+const uint32_t wireTok = 2;
+const uint32_t wireNode = 3;
+const uint32_t wireEnd = 4; // holds a uint32_t of flags
+
+// flags of wireEnd
+const uint32_t wireCancelled = 1; // the rest of the source was never lexed or parsed
+
+// types of tokens & nodes, those of the lexer's items
+const int wireEOF = -1;
+const int wireErr = 0;
+const int wireBeginList = 5; // a list without an operator, it has no text
+const int wireEndList = 6;
+const int wireOp = 20;
+const int wireNum = 21;
+const int wireChar = 22;
+const int wireStr = 23;
+
+// symbols are numbered from here in the order they are first seen,
+// builtins keep their id in tok/ops
+const uint32_t WireSymUser = 256;
+
+#define WireVersion 1
+
+typedef struct {
+	char magic[4]; // "BSKW"
+	uint32_t version;
+	uint32_t what; // wireTokens or wireAst
+} WireHead;
+
+typedef struct {
+	uint32_t type;
+	uint32_t len; // bytes after it, not counting padding
+} WireRec;
+
+typedef struct {
+	uint32_t off; // offset of its text in the source
+	uint32_t kind; // type << 24 | length, as Token
+	uint32_t sym; // symbol id of an operator, 0 otherwise
+	uint32_t triv; // length of the whitespace & comments before it, with --trivia
+} WireTok;
+
+typedef struct {
+	uint32_t off;
+	uint32_t kind;
+	uint32_t sym;
+	uint32_t nsub; // subtrees, which follow it
+} WireNode;
+
+// type of a token or node
+int wiretype (uint32_t kind) {return (int8_t) (kind >> 24);}
+
+// length of its text
+uint32_t wirelen (uint32_t kind) {return kind & 0xffffff;}
+
+#endif // WIRE
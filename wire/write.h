@@ -0,0 +1,287 @@
+#import <unistd.h> // write
+#import <fcntl.h> // vmsplice & F_SETPIPE_SZ, with _GNU_SOURCE on Linux
+#import <errno.h> // EINTR
+#import <string.h> // memcpy
+#import <sys/mman.h> // mmap
+#import <sys/stat.h> // fstat
+#import <sys/uio.h> // iovec
+#import "wire.h" // wire format
+#import "../tok/tok.h" // TokBuf
+#import "../parse/ast.h" // AsTree
+#import "../util/broadcast.h" // Broadcast
+#import "../util/hash.h" // fnv & HashTable
+#import "../util/govern.h" // gmalloc
+
+// Wire Writer
+// records are gathered into a buffer, written when it is full, so
+// the stream goes out in large batches as the lexer or parser makes
+// it. Tokens are written by a thread of their own, reading the token
+// broadcast beside the parser; trees by the parser, as each
+// top-level form ends.
+// When the stream is a pipe, buffers are spliced into it with
+// vmsplice rather than copied. The pipe then reads the buffer's pages
+// until the reader is done with them, so a buffer is only refilled
+// once the two after it have been spliced: they fill the pipe, so it
+// has been read.
+
+// Include guard.
+#ifndef WIREWRITE
+#define WIREWRITE
+
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+#define WIRE_SPLICE
+#endif
+
+#define WireBufs 3
+const int WireBufLen = 1 << 20; // and pipe size asked for
+
+typedef struct {
+	uint32_t off; // of its first text
+	uint32_t len;
+} WireSym;
+
+typedef struct {
+	int fd;
+	int pipe; // is fd spliced into?
+	char *buf[WireBufs]; // ring of buffers, mmap'd
+	int cur; // buffer being filled
+	long cap; // bytes each holds
+	long len; // bytes in buf[cur]
+	WireRec *rec; // record being filled, or NULL
+	uint32_t sent; // source bytes written
+	const char *src; // source sliced by what is being written
+	WireSym *sym; // operators, by id from WireSymUser
+	long nsym, maxsym;
+	HashTable syms; // of sym
+	Broadcast *cast; // tokens, when writing them
+	int sub; // subscriber number in cast
+	long out; // bytes written
+	int err;
+} Wire;
+
+Wire *initwire (int fd, int what) {
+	Wire *w = gcalloc(1, sizeof (Wire));
+	if (w == NULL){return NULL;}
+	w->fd = fd;
+	w->cap = WireBufLen;
+	if (inithash(&w->syms, 256, memStage)){return NULL;}
+#ifdef WIRE_SPLICE
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode)){
+		fcntl(fd, F_SETPIPE_SZ, WireBufLen); // may be over the limit, the size it has is kept
+		long n = fcntl(fd, F_GETPIPE_SZ);
+		if (n > 0){w->cap = n; w->pipe = 1;}
+	}
+#endif
+	for (int i = 0; i < WireBufs; i++){
+		w->buf[i] = mmap(NULL, w->cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (w->buf[i] == MAP_FAILED){w->buf[i] = NULL; return NULL;}
+	}
+	WireHead h = {.magic = "BSKW", .version = WireVersion, .what = what};
+	memcpy(w->buf[0], &h, sizeof h);
+	w->len = sizeof h;
+	return w;
+}
+
+// pages spliced into a pipe are kept by it, so buffers may be
+// unmapped before they are read
+int freewire (Wire *w) {
+	for (int i = 0; i < WireBufs; i++){
+		if (w->buf[i] != NULL){munmap(w->buf[i], w->cap);}
+	}
+	gfree(w->sym);
+	freehash(&w->syms);
+	gfree(w);
+	return 0;
+}
+
+// writes n bytes at s, splicing them into a pipe
+int _wirewrite (Wire *w, char *s, long n) {
+	while (n > 0){
+		ssize_t k;
+#ifdef WIRE_SPLICE
+		struct iovec v = {.iov_base = s, .iov_len = n};
+		if (w->pipe){k = vmsplice(w->fd, &v, 1, 0);}
+		else{k = write(w->fd, s, n);}
+		if (k < 0 && w->pipe && errno == EINVAL){w->pipe = 0; continue;} // not spliceable after all
+#else
+		k = write(w->fd, s, n);
+#endif
+		if (k < 0){
+			if (errno == EINTR){continue;}
+			gperr();
+			return 1;
+		}
+		w->out += k;
+		s += k; n -= k;
+	}
+	return 0;
+}
+
+// ends the record being filled, padding it to 4 bytes
+void _wireclose (Wire *w) {
+	if (w->rec == NULL){return;}
+	while (w->len % 4){w->buf[w->cur][w->len++] = 0;}
+	w->rec = NULL;
+}
+
+// writes the buffer & moves on to the next
+int _wireflush (Wire *w) {
+	_wireclose(w);
+	if (!w->err && _wirewrite(w, w->buf[w->cur], w->len)){w->err = 1;}
+	w->cur = (w->cur + 1) % WireBufs;
+	w->len = 0;
+	return w->err;
+}
+
+// opens a record of type, or goes on with the one being filled, with
+// at least min bytes of room. Returns the room it has, 0 on error.
+long _wireopen (Wire *w, uint32_t type, long min) {
+	if (w->rec != NULL && w->rec->type != type){_wireclose(w);}
+	long head = w->rec == NULL ? sizeof (WireRec) : 0;
+	long room = w->cap - 3 - w->len - head; // 3 to pad
+	if (room < min){
+		if (_wireflush(w)){return 0;}
+		head = sizeof (WireRec);
+		room = w->cap - 3 - head;
+	}
+	if (head > 0){
+		w->rec = (WireRec *) &w->buf[w->cur][w->len];
+		w->rec->type = type;
+		w->rec->len = 0;
+		w->len += head;
+	}
+	return room;
+}
+
+// the next n bytes of the open record, which has room for them
+char *_wiretake (Wire *w, long n) {
+	char *s = &w->buf[w->cur][w->len];
+	w->len += n;
+	w->rec->len += n;
+	return s;
+}
+
+// writes the source from what was sent up to end
+void _wiresrc (Wire *w, const char *src, uint32_t end) {
+	while (w->sent < end && !w->err){
+		long n = _wireopen(w, wireSrc, 1);
+		if (n == 0){return;}
+		if (n > end - w->sent){n = end - w->sent;}
+		memcpy(_wiretake(w, n), &src[w->sent], n);
+		w->sent += n;
+	}
+}
+
+// Symbols
+// operators are numbered as they are first seen, so readers can
+// tell them apart without comparing text.
+
+int _wireeq (void *v, long i, const void *key) {
+	Wire *w = (Wire *) v;
+	const WireSym *s = &w->sym[i], *k = key;
+	return s->len == k->len && memcmp(&w->src[s->off], &w->src[k->off], k->len) == 0;
+}
+
+// id of the operator at off in w->src
+uint32_t _wiresym (Wire *w, uint32_t off, uint32_t len, int op) {
+	if (op != opNone){return op;}
+	if (hashroom(&w->syms)){w->err = 1; gperr(); return 0;}
+	WireSym k = {.off = off, .len = len};
+	uint64_t h = fnv(FnvBasis, &w->src[off], len);
+	long s = hashfind(&w->syms, h, _wireeq, w, &k);
+	long i = hashat(&w->syms, s);
+	if (i < 0){
+		if (w->nsym >= w->maxsym){
+			long max = w->maxsym > 0 ? w->maxsym * 2 : 256;
+			WireSym *sym = grealloc(w->sym, max * sizeof (WireSym));
+			if (sym == NULL){w->err = 1; gperr(); return 0;}
+			w->sym = sym;
+			w->maxsym = max;
+		}
+		i = w->nsym++;
+		w->sym[i] = k;
+		hashput(&w->syms, s, h, i);
+	}
+	return WireSymUser + i;
+}
+
+// Tokens
+
+// writes a token buffer, after the source it slices
+int wiretoks (Wire *w, TokBuf *buf) {
+	uint32_t end = w->sent;
+	for (int i = 0; i < buf->len; i++){
+		uint32_t e = buf->off[i] + (buf->kind[i] & TokLenMax);
+		if (e > end){end = e;} // errors may overlap the tokens after them
+	}
+	_wiresrc(w, buf->src, end);
+	w->src = buf->src;
+	for (int i = 0; i < buf->len && !w->err;){
+		long n = _wireopen(w, wireTok, sizeof (WireTok)) / sizeof (WireTok);
+		if (n == 0){break;}
+		if (n > buf->len - i){n = buf->len - i;}
+		WireTok *v = (WireTok *) _wiretake(w, n * sizeof (WireTok));
+		for (long j = 0; j < n; j++, i++){
+			Token t = tokat(buf, i);
+			WireTok u = {.off = t.off, .kind = t.kind, .sym = 0, .triv = buf->triv != NULL ? buf->triv[i] : 0};
+			if (toktype(&t) == itemOp){u.sym = _wiresym(w, t.off, toklen(&t), tokop(buf, i));}
+			v[j] = u;
+		}
+	}
+	return w->err;
+}
+
+// writes the tokens of the broadcast, until the last. A failed write
+// stops the stream, not the parse.
+void *wiretokens (void *v) {
+	Wire *w = (Wire *) v;
+	tracename("wire");
+	for (int eof = 0; !eof && !w->err;){
+		TokBuf *buf = bnext(w->cast, w->sub);
+		if (buf == NULL){break;} // cancelled
+		wiretoks(w, buf);
+		Token t = buf->len > 0 ? tokat(buf, buf->len - 1) : (Token) {0};
+		eof = toktype(&t) == itemEOF;
+	}
+	bdone(w->cast, w->sub);
+	return NULL;
+}
+
+// Trees
+
+int _wirenode (AsTree *tree, int depth, int exit, void *v) {
+	(void) depth; // pre-order with nsub says it
+	Wire *w = (Wire *) v;
+	if (exit){return 0;}
+	if (_wireopen(w, wireNode, sizeof (WireNode)) == 0){return 1;}
+	WireNode m = {.nsub = tree->len, .kind = (uint32_t) (uint8_t) wireBeginList << 24};
+	Node *n = tree->node;
+	if (n != NULL){
+		m.off = n->off;
+		m.kind = (uint32_t) (uint8_t) n->type << 24 | n->len;
+		if (n->type == itemOp){m.sym = _wiresym(w, n->off, n->len, n->op);}
+	}
+	memcpy(_wiretake(w, sizeof (WireNode)), &m, sizeof m);
+	return w->err;
+}
+
+// writes a top-level form, after the source up to end
+int wireform (Wire *w, AsTree *tree, const char *src, uint32_t end) {
+	if (w->err){return 1;}
+	_wiresrc(w, src, end);
+	w->src = src;
+	if (walkast(tree, _wirenode, w) && !w->err){w->err = 1; gperr();}
+	return w->err;
+}
+
+// ends the stream, writing what is left
+int wireend (Wire *w, int cancelled) {
+	if (w->err){return 1;}
+	if (_wireopen(w, wireEnd, sizeof (uint32_t)) == 0){return 1;}
+	uint32_t flags = cancelled ? wireCancelled : 0;
+	memcpy(_wiretake(w, sizeof flags), &flags, sizeof flags);
+	return _wireflush(w);
+}
+
+#endif // WIREWRITE